@@ -0,0 +1,362 @@
+// This module contains the streamed decoding of the MGCG files: the AES-CBC
+// decryption, run in blocks on a worker thread, and the DEFLATE decoder that
+// consumes them. It does not depend on Vulkan, so it can be tested alone.
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <plusaes.hpp>
+
+// Decrypts AES-CBC data (the MGCG files) in blocks on a worker thread: the
+// caller consumes the plain text of the blocks already decrypted, while the
+// following ones are being processed.
+class CBCDecryptStream {
+	static const size_t blockSize = 256 * 1024;	// multiple of the AES block
+	static const int slots = 4;
+
+	const unsigned char *data = nullptr;
+	size_t size = 0;
+	std::vector<unsigned char> key;
+	unsigned char iv[16];
+
+	std::vector<unsigned char> buf[slots];
+	size_t len[slots];
+	int produced = 0, consumed = 0;
+	bool holding = false, done = false, quit = false, failed = false;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::thread worker;
+
+	void workerLoop();
+
+	public:
+	void start(const unsigned char *_data, size_t _size, const std::vector<unsigned char> &_key, const unsigned char _iv[16]);
+	// next decrypted block (releasing the previous one), 0 at the end
+	size_t next(const unsigned char *&ptr);
+	void stop();
+	~CBCDecryptStream() {stop();}
+};
+
+// DEFLATE decoder pulling the compressed bytes from a callback, so that they
+// can be produced while the output is being inflated. The output buffer must
+// hold the whole stream, since it is also the history window.
+class StreamInflater {
+	std::function<size_t(const unsigned char *&)> source;
+	const unsigned char *in = nullptr, *inEnd = nullptr;
+	uint64_t bitbuf = 0;
+	int bitcnt = 0;
+	int overrun = 0;
+
+	struct Huffman {
+		static const int fastBits = 10;
+		uint16_t fast[1 << fastBits];	// (length << 9) | symbol, 0 if longer
+		uint16_t count[16];
+		uint16_t symbol[288];
+		void build(const unsigned char *lens, int n);
+	};
+	Huffman lit, dist;
+
+	bool fetch();
+	void refill();
+	uint32_t bits(int n);
+	int decode(Huffman &H);
+
+	public:
+	// returns the number of bytes written, or -1 if the stream is corrupted
+	long long inflate(unsigned char *out, size_t cap, std::function<size_t(const unsigned char *&)> _source);
+};
+
+#ifdef INFLATE_IMPLEMENTATION
+void CBCDecryptStream::start(const unsigned char *_data, size_t _size, const std::vector<unsigned char> &_key, const unsigned char _iv[16]) {
+	data = _data;
+	size = _size;
+	key = _key;
+	memcpy(iv, _iv, 16);
+	for(int i = 0; i < slots; i++) {
+		buf[i].resize(blockSize);
+	}
+	produced = consumed = 0;
+	holding = done = quit = failed = false;
+	worker = std::thread(&CBCDecryptStream::workerLoop, this);
+}
+
+void CBCDecryptStream::workerLoop() {
+	for(size_t off = 0; off < size; off += blockSize) {
+		int slot;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, [this] {return quit || (produced - consumed < slots);});
+			if(quit) return;
+			slot = produced % slots;
+		}
+		size_t n = std::min(blockSize, size - off);
+		bool last = (off + n == size);
+		// in CBC mode the iv of a block is the previous cipher text block
+		unsigned char blockIv[16];
+		memcpy(blockIv, (off == 0) ? iv : data + off - 16, 16);
+		unsigned long padded = 0;
+		plusaes::Error e = plusaes::decrypt_cbc(data + off, n, key.data(), key.size(), &blockIv,
+							buf[slot].data(), n, last ? &padded : nullptr);
+		{
+			std::lock_guard<std::mutex> lock(mtx);
+			if(e != plusaes::kErrorOk) {
+				failed = done = true;
+				cv.notify_all();
+				return;
+			}
+			len[slot] = n - padded;
+			produced++;
+		}
+		cv.notify_all();
+	}
+	std::lock_guard<std::mutex> lock(mtx);
+	done = true;
+	cv.notify_all();
+}
+
+size_t CBCDecryptStream::next(const unsigned char *&ptr) {
+	std::unique_lock<std::mutex> lock(mtx);
+	if(holding) {
+		consumed++;
+		holding = false;
+		cv.notify_all();
+	}
+	cv.wait(lock, [this] {return (produced > consumed) || done;});
+	if(failed) {
+		throw std::runtime_error("failed to decrypt MGCG data!");
+	}
+	if(produced == consumed) return 0;
+	int slot = consumed % slots;
+	ptr = buf[slot].data();
+	holding = true;
+	return len[slot];
+}
+
+void CBCDecryptStream::stop() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		quit = true;
+	}
+	cv.notify_all();
+	if(worker.joinable()) {
+		worker.join();
+	}
+}
+
+void StreamInflater::Huffman::build(const unsigned char *lens, int n) {
+	uint16_t offs[16];
+	memset(count, 0, sizeof(count));
+	memset(fast, 0, sizeof(fast));
+	for(int i = 0; i < n; i++) {
+		count[lens[i]]++;
+	}
+	count[0] = 0;
+	offs[1] = 0;
+	for(int l = 1; l < 15; l++) {
+		offs[l + 1] = offs[l] + count[l];
+	}
+	for(int i = 0; i < n; i++) {
+		if(lens[i] != 0) {
+			symbol[offs[lens[i]]++] = i;
+		}
+	}
+	// canonical codes, stored bit reversed since they are read LSB first
+	int code = 0, k = 0;
+	for(int l = 1; l <= fastBits; l++) {
+		for(int c = 0; c < count[l]; c++, k++, code++) {
+			int rev = 0;
+			for(int b = 0; b < l; b++) {
+				rev |= ((code >> b) & 1) << (l - 1 - b);
+			}
+			for(int j = rev; j < (1 << fastBits); j += (1 << l)) {
+				fast[j] = (l << 9) | symbol[k];
+			}
+		}
+		code <<= 1;
+	}
+}
+
+bool StreamInflater::fetch() {
+	size_t n = source(in);
+	inEnd = in + n;
+	return n > 0;
+}
+
+void StreamInflater::refill() {
+	if(inEnd - in >= 8) {
+		uint64_t w;
+		memcpy(&w, in, 8);
+		bitbuf |= w << bitcnt;
+		in += (63 - bitcnt) >> 3;
+		bitcnt |= 56;
+		return;
+	}
+	while(bitcnt <= 56) {
+		if((in == inEnd) && !fetch()) {
+			// past the end: zeros, counted to detect truncated streams
+			overrun++;
+			bitcnt += 8;
+			continue;
+		}
+		bitbuf |= (uint64_t)(*in++) << bitcnt;
+		bitcnt += 8;
+	}
+}
+
+uint32_t StreamInflater::bits(int n) {
+	if(bitcnt < n) refill();
+	uint32_t v = (uint32_t)(bitbuf & ((1ull << n) - 1));
+	bitbuf >>= n;
+	bitcnt -= n;
+	return v;
+}
+
+int StreamInflater::decode(Huffman &H) {
+	if(bitcnt < 15) refill();
+	uint16_t e = H.fast[bitbuf & ((1 << Huffman::fastBits) - 1)];
+	if(e != 0) {
+		bitbuf >>= (e >> 9);
+		bitcnt -= (e >> 9);
+		return e & 511;
+	}
+	// codes longer than the fast table
+	int code = 0, first = 0, index = 0;
+	for(int l = 1; l < 16; l++) {
+		code |= bits(1);
+		int c = H.count[l];
+		if(code - c < first) {
+			return H.symbol[index + (code - first)];
+		}
+		index += c;
+		first = (first + c) << 1;
+		code <<= 1;
+	}
+	return -1;
+}
+
+long long StreamInflater::inflate(unsigned char *out, size_t cap, std::function<size_t(const unsigned char *&)> _source) {
+	static const unsigned char order[19] = {16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15};
+	static const uint16_t lbase[29] = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+	static const unsigned char lextra[29] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+	static const uint16_t dbase[30] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+	static const unsigned char dextra[30] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+	source = _source;
+	in = inEnd = nullptr;
+	bitbuf = 0;
+	bitcnt = 0;
+	overrun = 0;
+	unsigned char *o = out, *oe = out + cap;
+
+	int last = 0;
+	while(!last) {
+		last = bits(1);
+		int type = bits(2);
+		if(type == 0) {
+			// stored block: byte aligned, copied as it is
+			bits(bitcnt & 7);
+			uint32_t len = bits(16);
+			uint32_t nlen = bits(16);
+			if(((len ^ 0xFFFF) != nlen) || (len > (size_t)(oe - o))) return -1;
+			while((len > 0) && (bitcnt >= 8)) {
+				*o++ = (unsigned char)bits(8);
+				len--;
+			}
+			// the rest is copied from the input: the look-ahead bits loaded
+			// by refill() are stale once it moves past them
+			if(len > 0) {
+				bitbuf = 0;
+			}
+			while(len > 0) {
+				if((in == inEnd) && !fetch()) return -1;
+				size_t n = std::min((size_t)len, (size_t)(inEnd - in));
+				memcpy(o, in, n);
+				o += n;
+				in += n;
+				len -= n;
+			}
+			continue;
+		}
+
+		unsigned char lens[288 + 32];
+		int nlit, ndist;
+		if(type == 1) {
+			nlit = 288;
+			ndist = 32;
+			memset(lens, 8, 144);
+			memset(lens + 144, 9, 112);
+			memset(lens + 256, 7, 24);
+			memset(lens + 280, 8, 8);
+			memset(lens + 288, 5, 32);
+		} else if(type == 2) {
+			nlit = 257 + bits(5);
+			ndist = 1 + bits(5);
+			int ncode = 4 + bits(4);
+			unsigned char clens[19] = {0};
+			for(int i = 0; i < ncode; i++) {
+				clens[order[i]] = bits(3);
+			}
+			Huffman CL;
+			CL.build(clens, 19);
+			for(int n = 0; n < nlit + ndist;) {
+				int sym = decode(CL);
+				int rep = 0, val = 0;
+				if(sym < 0) {
+					return -1;
+				} else if(sym < 16) {
+					lens[n++] = sym;
+					continue;
+				} else if(sym == 16) {
+					if(n == 0) return -1;
+					val = lens[n - 1];
+					rep = 3 + bits(2);
+				} else if(sym == 17) {
+					rep = 3 + bits(3);
+				} else {
+					rep = 11 + bits(7);
+				}
+				if(n + rep > nlit + ndist) return -1;
+				memset(lens + n, val, rep);
+				n += rep;
+			}
+		} else {
+			return -1;
+		}
+		lit.build(lens, nlit);
+		dist.build(lens + nlit, ndist);
+
+		while(true) {
+			int sym = decode(lit);
+			if(sym < 256) {
+				if((sym < 0) || (o >= oe)) return -1;
+				*o++ = sym;
+			} else if(sym == 256) {
+				break;
+			} else {
+				sym -= 257;
+				if(sym >= 29) return -1;
+				uint32_t len = lbase[sym] + bits(lextra[sym]);
+				int ds = decode(dist);
+				if((ds < 0) || (ds >= 30)) return -1;
+				size_t d = dbase[ds] + bits(dextra[ds]);
+				if((d > (size_t)(o - out)) || (len > (size_t)(oe - o))) return -1;
+				const unsigned char *src = o - d;
+				if(d >= len) {
+					memcpy(o, src, len);
+					o += len;
+				} else {
+					while(len-- > 0) *o++ = *src++;
+				}
+			}
+		}
+		if(overrun > 8) return -1;
+	}
+	return o - out;
+}
+#endif
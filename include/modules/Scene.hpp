@@ -2,17 +2,22 @@
 struct TechniqueInstances;
 
 struct Instance {
-	std::string *id;
+	const char *id;			// in the string table of the scene description
 	int Mid;
 	int NTx;
 	int Iid;
-	int *Tid;
+	const int32_t *Tid;
 	DescriptorSet ***DS;
 	std::vector<DescriptorSetLayout *> **D;
 	int *NDs;
 	
 	glm::mat4 Wm;
 	TechniqueInstances *TIp;
+
+	// drawn only once its model and all its textures have been loaded
+	bool ready;
+	// takes the transform of the model when it is loaded
+	bool modelWm;
 } ;
 
 struct TextureDefs {
@@ -58,8 +63,10 @@ class Scene {
 	// Models, textures and Descriptors (values assigned to the uniforms)
 	// Please note that Model objects depends on the corresponding vertex structure
 	// Asset files
+	// (parsed on demand, only if the meshes they contain have not been baked)
 	int AssetFileCount = 0;
-	AssetFile **As;
+	std::vector<std::string> AsFile;
+	std::vector<ModelType> AsType;
 	std::unordered_map<std::string, int> AsIds;
 
 	// Models
@@ -76,9 +83,15 @@ class Scene {
 	int InstanceCount = 0;
 
 	Instance **I;
+	Instance *InstanceData;
+	std::vector<std::vector<DescriptorSetLayout *> *> InstanceLayouts;
+	std::vector<int> InstanceNDs;
 	VertexDescriptorRef *VRef;
 	std::unordered_map<std::string, int> InstanceIds;
 
+	// Compiled scene description (names are resolved from its string table)
+	SceneBlob Blob;
+
 	// Pipelines, DSL and Vertex Formats
 	std::unordered_map<std::string, TechniqueRef *> TechniqueIds;
 	int TechniqueInstanceCount = 0;
@@ -87,12 +100,31 @@ class Scene {
 	int Npasses;
 
 
+	// Asynchronous loading: init() parses the scene and starts decoding the
+	// files on the workers, then updateLoading() (called once per frame)
+	// uploads what is ready and makes drawable the completed instances
+	ThreadPool loader;
+	bool loading = false;
+	int LoadedCount = 0;
+	float uploadBudget = 8.0f;	// ms per frame spent uploading to the GPU
+	std::chrono::high_resolution_clock::time_point loadStart;
+	std::vector<std::future<void>> modelJobs, textureJobs;
+	std::vector<float> modelTimes, textureTimes;
+	std::vector<bool> modelReady, textureReady;
+	std::vector<std::string> modelNames, textureFiles;
+	std::vector<VkFormat> textureFmts;
+
 	int init(BaseProject *_BP,  int _Npasses, std::vector<VertexDescriptorRef>  &VDRs, std::vector<TechniqueRef> &PRs, std::string file);
+	bool updateLoading();
+	bool isLoading() {return loading;}
+	int getLoadingCount() {return ModelCount + TextureCount;}
 
 	void pipelinesAndDescriptorSetsInit();
 	void pipelinesAndDescriptorSetsCleanup();
 	void localCleanup();
     void populateCommandBuffer(VkCommandBuffer commandBuffer, int passId, int currentImage);
+	// reports the streaming textures of the instances in view
+	void markTexturesUsed(glm::mat4 ViewPrj, glm::vec3 camPos);
 };
 
 #ifdef SCENE_IMPLEMENTATION
@@ -125,260 +157,308 @@ int Scene::init(BaseProject *_BP,  int _Npasses, std::vector<VertexDescriptorRef
 		TechniqueIds[*PRs[i].id] = &PRs[i];
 	}
 
-	// Models, textures and Descriptors (values assigned to the uniforms)
-	nlohmann::json js;
-	std::ifstream ifs(file);
-	if (!ifs.is_open()) {
-	  std::cout << "Error! Scene file >" << file << "< not found!";
-	  exit(-1);
-	}
-//		try {
-		std::cout << "Parsing JSON\n";
-		ifs >> js;
-		ifs.close();
-		std::cout << "\nScene contains " << js.size() << " definitions sections\n\n";
-		
-		// ASSET FILES
-		nlohmann::json afs = js["assetfiles"];
-		AssetFileCount = afs.size();
-		std::cout << "Asset Files count: " << AssetFileCount << "\n";
-
-		As = (AssetFile **)calloc(AssetFileCount, sizeof(AssetFile *));
-		for(int k = 0; k < AssetFileCount; k++) {
-			AsIds[afs[k]["id"]] = k;
-			std::string MT = afs[k]["format"].template get<std::string>();
-
-			As[k] = new AssetFile();
-			As[k]->init(afs[k]["file"], (MT[0] == 'O') ? OBJ : ((MT[0] == 'G') ? GLTF : MGCG));
-			if (MT[0] == 'G') {
-				// Solo se è un GLTF
-				tinygltf::TinyGLTF loader;
-				tinygltf::Model model;
-				std::string warn, err;
-				std::string path = afs[k]["file"];
-
-				bool ok = loader.LoadASCIIFromFile(&model, &warn, &err, path);
-				if (!ok) {
-					std::cerr << "Failed to load GLTF file for debug: " << path << "\n";
-					std::cerr << "Error: " << err << "\n";
-				} else {
-					std::cout << "\n=== DEBUG INFO FROM: " << path << " ===\n";
-					for (size_t m = 0; m < model.meshes.size(); ++m) {
-						const auto& mesh = model.meshes[m];
-						std::cout << "Mesh " << m << ": " << mesh.name << "\n";
-						for (size_t p = 0; p < mesh.primitives.size(); ++p) {
-							const auto& prim = mesh.primitives[p];
-							std::cout << "  Primitive " << p << ":\n";
-							for (const auto& attr : prim.attributes) {
-								std::cout << "    Attribute: " << attr.first << "\n";
-							}
-						}
-					}
-					std::cout << "Skins: " << model.skins.size() << "\n";
-					std::cout << "Animations: " << model.animations.size() << "\n";
-					std::cout << "===============================\n";
-				}
+	// Scene description: the compiled scene when present and up to date,
+	// otherwise the .json file parsed in SAX mode into the same format
+	{
+		ProfileScope PS("Scene description");
+		std::string compiled = SceneBlob::compiledName(file);
+		if(Blob.load(compiled, file)) {
+			std::cout << "Using the compiled scene: " << compiled << "\n";
+		} else {
+			std::cout << "Parsing JSON (SAX)\n";
+			if(!Blob.compile(file)) {
+				std::cout << "Error! Cannot load the scene file >" << file << "<\n";
+				exit(-1);
 			}
-
-		}
-		
-		// MODELS
-		nlohmann::json ms = js["models"];
-		ModelCount = ms.size();
-		std::cout << "Models count: " << ModelCount << "\n";
-
-		M = (Model **)calloc(ModelCount, sizeof(Model *));
-		for(int k = 0; k < ModelCount; k++) {
-			MeshIds[ms[k]["id"]] = k;
-			std::string MT = ms[k]["format"].template get<std::string>();
-			std::string VDN = ms[k]["VD"].template get<std::string>();
-
-			M[k] = new Model();
-			if(MT[0] == 'A') {
-				// init from asset file
-				std::string AN = ms[k]["asset"].template get<std::string>();
-//std::cout << "Getting from asset: '" << AN << "'\n";
-				int aId = AsIds[AN];
-//std::cout << "aId " << aId << "\n";
-				M[k]->initFromAsset(BP, VDIds[VDN], As[aId], ms[k]["model"], ms[k]["meshId"], ms[k]["node"]);
-			} else {
-				M[k]->init(BP, VDIds[VDN], ms[k]["model"], (MT[0] == 'O') ? OBJ : ((MT[0] == 'G') ? GLTF : MGCG));
+			// written next to the source, so the next run can skip the parsing
+			if(Blob.save(compiled)) {
+				std::cout << "Compiled scene saved: " << compiled << "\n";
 			}
 		}
-		
-		// TEXTURES
-		nlohmann::json ts = js["textures"];
-		TextureCount = ts.size();
-		std::cout << "Textures count: " << TextureCount << "\n";
-
-		T = (Texture **)calloc(TextureCount, sizeof(Texture *));
-		for(int k = 0; k < TextureCount; k++) {
-			TextureIds[ts[k]["id"]] = k;
-			std::string TT = ts[k]["format"].template get<std::string>();
-
-			T[k] = new Texture();
-			if(TT[0] == 'C') {
-				T[k]->init(BP, ts[k]["texture"]);
-			} else if(TT[0] == 'D') {
-				T[k]->init(BP, ts[k]["texture"], VK_FORMAT_R8G8B8A8_UNORM);
-			} else {
-				std::cout << "FORMAT UNKNOWN: " << TT << "\n";
-			}
-std::cout << ts[k]["id"] << "(" << k << ") " << TT << "\n";
+	}
+	const SceneBlobHeader *H = Blob.header();
+
+	// Files are decoded and parsed in parallel by a pool of workers, while
+	// the main thread uploads to the GPU each element in updateLoading()
+	// as soon as it is ready
+	loadStart = std::chrono::high_resolution_clock::now();
+	loading = true;
+	Profiler::hold();
+	LoadedCount = 0;
+	loader.init();
+	std::cout << "Loading with " << loader.size() << " worker threads\n";
+	
+	// ASSET FILES (shared with the other loaders through the asset cache)
+	const SceneBlobAsset *afs = Blob.assets();
+	AssetFileCount = H->assetCount;
+	std::cout << "Asset Files count: " << AssetFileCount << "\n";
+
+	AsFile.resize(AssetFileCount);
+	AsType.resize(AssetFileCount);
+	for(int k = 0; k < AssetFileCount; k++) {
+		AsIds[Blob.str(afs[k].id)] = k;
+		AsFile[k] = Blob.str(afs[k].file);
+		AsType[k] = (afs[k].format == 'O') ? OBJ : ((afs[k].format == 'G') ? GLTF : MGCG);
+	}
+	
+	// MODELS
+	const SceneBlobModel *ms = Blob.models();
+	ModelCount = H->modelCount;
+	std::cout << "Models count: " << ModelCount << "\n";
+
+	M = (Model **)calloc(ModelCount, sizeof(Model *));
+	modelJobs.resize(ModelCount);
+	modelTimes.resize(ModelCount);
+	modelReady.assign(ModelCount, false);
+	modelNames.resize(ModelCount);
+	for(int k = 0; k < ModelCount; k++) {
+		MeshIds[Blob.str(ms[k].id)] = k;
+		modelNames[k] = Blob.str(ms[k].id);
+		VertexDescriptor *VD = VDIds[Blob.str(ms[k].VD)];
+
+		M[k] = new Model();
+		if(ms[k].format == 'A') {
+			// init from asset file
+			std::string MN = Blob.str(ms[k].model), NN = Blob.str(ms[k].node);
+			int Mid = ms[k].meshId;
+			std::string AF = AsFile[ms[k].asset];
+			ModelType AT = AsType[ms[k].asset];
+			modelJobs[k] = loader.submit([this, k, VD, AF, AT, MN, Mid, NN] {
+				ProfileScope PS("load " + MN, "model");
+				auto t0 = std::chrono::high_resolution_clock::now();
+				M[k]->loadFromAsset(BP, VD, AF, AT, MN, Mid, NN);
+				modelTimes[k] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+			});
+		} else {
+			std::string file = Blob.str(ms[k].model);
+			ModelType MdT = (ms[k].format == 'O') ? OBJ : ((ms[k].format == 'G') ? GLTF : MGCG);
+			modelJobs[k] = loader.submit([this, k, VD, file, MdT] {
+				ProfileScope PS("load " + file, "model");
+				auto t0 = std::chrono::high_resolution_clock::now();
+				M[k]->load(BP, VD, file, MdT);
+				modelTimes[k] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+			});
 		}
+	}
+	
+	// TEXTURES
+	const SceneBlobTexture *ts = Blob.textures();
+	TextureCount = H->textureCount;
+	std::cout << "Textures count: " << TextureCount << "\n";
+
+	T = (Texture **)calloc(TextureCount, sizeof(Texture *));
+	textureJobs.resize(TextureCount);
+	textureTimes.resize(TextureCount);
+	textureReady.assign(TextureCount, false);
+	textureFiles.resize(TextureCount);
+	textureFmts.resize(TextureCount);
+	for(int k = 0; k < TextureCount; k++) {
+		TextureIds[Blob.str(ts[k].id)] = k;
+		char TT = ts[k].format;
+		bool stream = ts[k].stream != 0;
+		std::string file = Blob.str(ts[k].file);
+		textureFiles[k] = file;
+
+		T[k] = new Texture();
+		if((TT == 'C') || (TT == 'D')) {
+			textureFmts[k] = (TT == 'C') ? VK_FORMAT_R8G8B8A8_SRGB : VK_FORMAT_R8G8B8A8_UNORM;
+			// descriptor sets can be created before the texture is loaded
+			T[k]->initPlaceholder(BP, textureFmts[k]);
+			textureJobs[k] = loader.submit([this, k, file, stream] {
+				ProfileScope PS("decode " + file, "texture");
+				auto t0 = std::chrono::high_resolution_clock::now();
+				T[k]->decode(file, stream);
+				textureTimes[k] = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+			});
+		} else {
+			std::cout << "FORMAT UNKNOWN: " << TT << "\n";
+			textureReady[k] = true;
+			LoadedCount++;
+		}
+	}
 
-		// INSTANCES TextureCount
-		nlohmann::json pis = js["instances"];
-		TechniqueInstanceCount = pis.size();
+	// INSTANCES
+	// all the instances, and their per pass layouts, are stored in single arrays
+	const SceneBlobTechnique *pis = Blob.techniques();
+	const SceneBlobInstance *is = Blob.instances();
+	TechniqueInstanceCount = H->techniqueCount;
+	InstanceCount = H->instanceCount;
 std::cout << "Technique Instances count: " << TechniqueInstanceCount << "\n";
-		TI = (TechniqueInstances *)calloc(TechniqueInstanceCount, sizeof(TechniqueInstances));
-		InstanceCount = 0;
+	TI = (TechniqueInstances *)calloc(TechniqueInstanceCount, sizeof(TechniqueInstances));
+	InstanceData = (Instance *)calloc(InstanceCount, sizeof(Instance));
+	InstanceLayouts.resize(InstanceCount * Npasses);
+	InstanceNDs.resize(InstanceCount * Npasses);
 
-		for(int k = 0; k < TechniqueInstanceCount; k++) {
-			std::string Pid = pis[k]["technique"].template get<std::string>();
-			
-			TI[k].T = TechniqueIds[Pid];
-			nlohmann::json is = pis[k]["elements"];
-			TI[k].InstanceCount = is.size();
+	for(int k = 0; k < TechniqueInstanceCount; k++) {
+		const char *Pid = Blob.str(pis[k].technique);
+		if(TechniqueIds.find(Pid) == TechniqueIds.end()) {
+			std::cout << "Scene Error: unknown technique " << Pid << "\n";
+			exit(0);
+		}
+		TI[k].T = TechniqueIds[Pid];
+		TI[k].InstanceCount = pis[k].instanceCount;
+		TI[k].I = InstanceData + pis[k].firstInstance;
 std::cout << "Technique: " << Pid << "(" << k << "), Instances count: " << TI[k].InstanceCount << "\n";
-			TI[k].I = (Instance *)calloc(TI[k].InstanceCount, sizeof(Instance));
-			
-			for(int j = 0; j < TI[k].InstanceCount; j++) {
+		
+		for(int j = 0; j < TI[k].InstanceCount; j++) {
+			const SceneBlobInstance &BI = is[pis[k].firstInstance + j];
+			Instance &In = TI[k].I[j];
+			int i = pis[k].firstInstance + j;
 			
-std::cout << k << "." << j << "\t" << is[j]["id"] << ", " << is[j]["model"] << "(" << MeshIds[is[j]["model"]] << "), {";
-				TI[k].I[j].id  = new std::string(is[j]["id"]);
-				TI[k].I[j].Mid = MeshIds[is[j]["model"]];
-				int NTextures = is[j]["texture"].size();
-				if(NTextures != TI[k].T->Ntextures) {
-					std::cout << "Wrong number of textures!\n";
-					exit(0);
+			In.id  = Blob.str(BI.id);
+			In.Mid = BI.model;
+			if(BI.textureCount != TI[k].T->Ntextures) {
+				std::cout << "Wrong number of textures!\n";
+				exit(0);
+			}
+			In.NTx = BI.textureCount;
+			In.Tid = Blob.textureRefs() + BI.firstTexture;
+
+			if(BI.flags & SBT_MATRIX) {
+				const float *TMj = BI.transform;
+				In.Wm = glm::mat4(TMj[0],TMj[4],TMj[8],TMj[12],TMj[1],TMj[5],TMj[9],TMj[13],TMj[2],TMj[6],TMj[10],TMj[14],TMj[3],TMj[7],TMj[11],TMj[15]);
+			} else if(BI.flags != 0) {
+				glm::vec3 trT = glm::vec3(0.0f);
+				glm::mat4 trR = glm::mat4(1.0f);
+				glm::vec3 trS = glm::vec3(1.0f);
+				if(BI.flags & SBT_TRANSLATE) {
+					trT = glm::vec3(BI.translate[0], BI.translate[1], BI.translate[2]);
 				}
-				TI[k].I[j].NTx = NTextures;
-				TI[k].I[j].Tid = (int *)calloc(NTextures, sizeof(int));
-std::cout << "#" << NTextures;
-				for(int h = 0; h < NTextures; h++) {
-					TI[k].I[j].Tid[h] = TextureIds[is[j]["texture"][h]];
-std::cout << " " << is[j]["texture"][h] << "(" << TI[k].I[j].Tid[h] << ")";
+				if(BI.flags & SBT_EULER) {
+					trR = glm::rotate(glm::mat4(1.0f),
+									  glm::radians(BI.eulerAngles[1]),
+									  glm::vec3(0.0f,1.0f,0.0f)) *
+						  glm::rotate(glm::mat4(1.0f),
+									  glm::radians(BI.eulerAngles[0]),
+									  glm::vec3(1.0f,0.0f,0.0f)) *
+						  glm::rotate(glm::mat4(1.0f),
+									  glm::radians(BI.eulerAngles[2]),
+									  glm::vec3(0.0f,0.0f,1.0f));
+				} else if(BI.flags & SBT_QUATERNION) {
+					glm::quat trQ = glm::quat(BI.quaternion[0],
+											  BI.quaternion[1],
+											  BI.quaternion[2],
+											  BI.quaternion[3]);
+					trR = glm::mat4(trQ);
 				}
-std::cout << "}\n";
-				nlohmann::json TMjson = is[j]["transform"];
-				if(TMjson.is_null()) {
-std::cout << "Node has no transform: seek for translation, rotation and scaling\n";
-					bool manualPos = false;
-					
-					glm::vec3 trT = glm::vec3(0.0f);
-					glm::mat4 trR = glm::mat4(1.0f);
-					glm::vec3 trS = glm::vec3(1.0f);
-					nlohmann::json Tr_Tjson = is[j]["translate"];
-					if(!Tr_Tjson.is_null()) {
-						trT.x = Tr_Tjson[0];
-						trT.y = Tr_Tjson[1];
-						trT.z = Tr_Tjson[2];
-						manualPos = true;
-					}
-					
-					nlohmann::json Tr_REjson = is[j]["eulerAngles"];
-					if(!Tr_REjson.is_null()) {
-						trR = glm::rotate(glm::mat4(1.0f),
-										  glm::radians((float)Tr_REjson[1]),
-										  glm::vec3(0.0f,1.0f,0.0f)) *
-							  glm::rotate(glm::mat4(1.0f),
-										  glm::radians((float)Tr_REjson[0]),
-										  glm::vec3(1.0f,0.0f,0.0f)) *
-							  glm::rotate(glm::mat4(1.0f),
-										  glm::radians((float)Tr_REjson[2]),
-										  glm::vec3(0.0f,0.0f,1.0f));
-						manualPos = true;
-					} else {
-						nlohmann::json Tr_RQjson = is[j]["quaternion"];
-						if(!Tr_RQjson.is_null()) {
-							glm::quat trQ = glm::quat(Tr_RQjson[0],
-													  Tr_RQjson[1],
-													  Tr_RQjson[2],
-													  Tr_RQjson[3]);
-							trR = glm::mat4(trQ);
-							manualPos = true;
-						}
-					}
-
-					nlohmann::json Tr_Sjson = is[j]["scale"];
-					if(!Tr_Sjson.is_null()) {
-						trS.x = Tr_Sjson[0];
-						trS.y = Tr_Sjson[1];
-						trS.z = Tr_Sjson[2];
-						manualPos = true;
-					}
-					
-					if(manualPos) {
-						TI[k].I[j].Wm = glm::translate(glm::mat4(1.0f), trT) *
-										trR *
-										glm::scale(glm::mat4(1.0f), trS);
-					} else {
-						TI[k].I[j].Wm = M[TI[k].I[j].Mid]->Wm;
-std::cout << "Using model transform matrix: " << TI[k].I[j].Mid << "\n";
-for(int mmm = 0; mmm < 16; mmm++) {
-	std::cout << TI[k].I[j].Wm[mmm%4][mmm/4] << ", ";
-}
-std::cout << "\n";
-					}
-				} else {
-					float TMj[16];
-					for(int h = 0; h < 16; h++) {TMj[h] = TMjson[h];}
-					TI[k].I[j].Wm = glm::mat4(TMj[0],TMj[4],TMj[8],TMj[12],TMj[1],TMj[5],TMj[9],TMj[13],TMj[2],TMj[6],TMj[10],TMj[14],TMj[3],TMj[7],TMj[11],TMj[15]);
-				}	
-				TI[k].I[j].TIp = &TI[k];
-				TI[k].I[j].D = (std::vector<DescriptorSetLayout *> **)calloc(sizeof(std::vector<DescriptorSetLayout *> *), Npasses);
-				TI[k].I[j].NDs = (int *)calloc(sizeof(int), Npasses);
-				for(int ipas = 0; ipas < Npasses; ipas++) {
-					TI[k].I[j].D[ipas] = &TI[k].T->PT[ipas].P->D;
-					TI[k].I[j].NDs[ipas] = TI[k].I[j].D[ipas]->size();
-					BP->DPSZs.setsInPool += TI[k].I[j].NDs[ipas];
-					for(int h = 0; h < TI[k].I[j].NDs[ipas]; h++) {
-						DescriptorSetLayout *DSL = (*TI[k].I[j].D[ipas])[h];
-						int DSLsize = DSL->Bindings.size();
-
-						for (int l = 0; l < DSLsize; l++) {
-							if(DSL->Bindings[l].type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
-								BP->DPSZs.uniformBlocksInPool += 1;
-							} else {
-								BP->DPSZs.texturesInPool += 1;
-							}
+				if(BI.flags & SBT_SCALE) {
+					trS = glm::vec3(BI.scale[0], BI.scale[1], BI.scale[2]);
+				}
+				In.Wm = glm::translate(glm::mat4(1.0f), trT) *
+						trR *
+						glm::scale(glm::mat4(1.0f), trS);
+			} else {
+				// set by updateLoading() when the model is ready
+				In.Wm = glm::mat4(1.0f);
+				In.modelWm = true;
+std::cout << "Using model transform matrix: " << In.Mid << "\n";
+			}
+			In.TIp = &TI[k];
+			In.D = &InstanceLayouts[i * Npasses];
+			In.NDs = &InstanceNDs[i * Npasses];
+			for(int ipas = 0; ipas < Npasses; ipas++) {
+				In.D[ipas] = &TI[k].T->PT[ipas].P->D;
+				In.NDs[ipas] = In.D[ipas]->size();
+				BP->DPSZs.setsInPool += In.NDs[ipas];
+				for(int h = 0; h < In.NDs[ipas]; h++) {
+					DescriptorSetLayout *DSL = (*In.D[ipas])[h];
+					int DSLsize = DSL->Bindings.size();
+
+					for (int l = 0; l < DSLsize; l++) {
+						if(DSL->Bindings[l].type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+							BP->DPSZs.uniformBlocksInPool += 1;
+						} else {
+							BP->DPSZs.texturesInPool += 1;
 						}
 					}
 				}
-				InstanceCount++;
 			}
-		}			
+		}
+	}
 
 std::cout << "Creating instances\n";
-		I =  (Instance **)calloc(InstanceCount, sizeof(Instance *));
-
-		int i = 0;
-		for(int k = 0; k < TechniqueInstanceCount; k++) {
-			for(int j = 0; j < TI[k].InstanceCount; j++) {
-				I[i] = &TI[k].I[j];
-				InstanceIds[*I[i]->id] = i;
-				I[i]->Iid = i;
-				
-				i++;
+	I =  (Instance **)calloc(InstanceCount, sizeof(Instance *));
+	for(int i = 0; i < InstanceCount; i++) {
+		I[i] = &InstanceData[i];
+		InstanceIds[I[i]->id] = i;
+		I[i]->Iid = i;
+	}
+std::cout << InstanceCount << " instances created\n";
+
+	return 0;
+}
+
+bool Scene::updateLoading() {
+	if(!loading) return false;
+
+	auto frameStart = std::chrono::high_resolution_clock::now();
+	auto elapsed = [&frameStart]() {
+		return std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - frameStart).count();
+	};
+	auto isDone = [](std::future<void> &f) {
+		return f.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+	};
+
+	// nothing waits for the frames in flight: the new buffers are not used
+	// yet, and the placeholders are swapped image by image (see Texture::upload)
+	bool changed = false;
+	for(int k = 0; (k < ModelCount) && (elapsed() < uploadBudget); k++) {
+		if(modelReady[k] || !isDone(modelJobs[k])) continue;
+		changed = true;
+		modelJobs[k].get();
+		ProfileScope PS("upload " + modelNames[k], "model");
+		auto t0 = std::chrono::high_resolution_clock::now();
+		M[k]->upload();
+		float up = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+std::cout << "[Load] " << modelNames[k] << ": mesh " << modelTimes[k] << " ms, upload " << up << " ms\n";
+		modelReady[k] = true;
+		LoadedCount++;
+	}
+	for(int k = 0; (k < TextureCount) && (elapsed() < uploadBudget); k++) {
+		if(textureReady[k] || !isDone(textureJobs[k])) continue;
+		changed = true;
+		textureJobs[k].get();
+		ProfileScope PS("upload " + textureFiles[k], "texture");
+		auto t0 = std::chrono::high_resolution_clock::now();
+		T[k]->upload(BP, textureFmts[k]);
+		float up = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - t0).count();
+std::cout << "[Load] " << textureFiles[k] << ": decode " << textureTimes[k] << " ms, upload " << up << " ms\n";
+		textureReady[k] = true;
+		LoadedCount++;
+	}
+	for(int i = 0; (i < InstanceCount) && changed; i++) {
+		if(I[i]->ready || !modelReady[I[i]->Mid]) continue;
+		bool ready = true;
+		for(int h = 0; h < I[i]->NTx; h++) {
+			ready = ready && textureReady[I[i]->Tid[h]];
+		}
+		if(ready) {
+			if(I[i]->modelWm) {
+				I[i]->Wm = M[I[i]->Mid]->Wm;
 			}
+			I[i]->ready = true;
 		}
-std::cout << i << " instances created\n";
-
+	}
+	// the draw calls must include the new instances: each image is recorded
+	// again when it is acquired, once its previous frame is done
+	if(changed) {
+		BP->invalidateCommandBuffers();
+	}
 
-/*		} catch (const nlohmann::json::exception& e) {
-		std::cout << "\n\n\nException while parsing JSON file: " << file << "\n";
-		std::cout << e.what() << '\n' << '\n';
-		std::cout << std::flush;
-		return 1;
+	if(LoadedCount == getLoadingCount()) {
+		loader.cleanup();
+		loading = false;
+		std::cout << "[Load] Assets, models and textures loaded in " <<
+			std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - loadStart).count() << " ms\n";
+		// the trace includes the decoding and upload of every element
+		Profiler::release();
 	}
-*/
-//std::cout << "Leaving scene loading and creation\n";		
-	return 0;
+	return changed;
 }
 
 
 void Scene::pipelinesAndDescriptorSetsInit() {
+	ProfileScope PS("Scene descriptor sets");
 //std::cout << "Scene DS init\n";
 	for(int i = 0; i < InstanceCount; i++) {
 //std::cout << "I: " << i << ", NTx: " << I[i]->NTx << ", NDs: " << I[i]->NDs << ", nPasses: " << Npasses << "\n";
@@ -431,6 +511,13 @@ void Scene::pipelinesAndDescriptorSetsCleanup() {
 }
 
 void Scene::localCleanup() {
+	// waits for the workers still decoding
+	if(loading) {
+		loader.cleanup();
+		loading = false;
+		Profiler::release();
+	}
+
 	// Cleanup textures
 	for(int i = 0; i < TextureCount; i++) {
 		T[i]->cleanup();
@@ -445,19 +532,29 @@ void Scene::localCleanup() {
 	}
 	free(M);
 	
-	for(int i = 0; i < InstanceCount; i++) {
-		delete I[i]->id;
-		free(I[i]->Tid);
-	}
 	free(I);
-	
-	// To add: delete the also the datastructure relative to the pipeline
-	for(int i = 0; i < TechniqueInstanceCount; i++) {
-		free(TI[i].I);
-	}
+	free(InstanceData);
 	free(TI);
 }
 
+void Scene::markTexturesUsed(glm::mat4 ViewPrj, glm::vec3 camPos) {
+	for(int i = 0; i < InstanceCount; i++) {
+		if(!I[i]->ready) continue;
+		glm::vec4 bs = M[I[i]->Mid]->getBoundingSphere();
+		glm::vec3 c = glm::vec3(I[i]->Wm * glm::vec4(glm::vec3(bs), 1.0f));
+		float r = bs.w * glm::length(glm::vec3(I[i]->Wm[0]));
+
+		// rough frustum test of the bounding sphere in clip space
+		glm::vec4 p = ViewPrj * glm::vec4(c, 1.0f);
+		if((p.w < -r) || (fabs(p.x) > p.w + r) || (fabs(p.y) > p.w + r)) continue;
+
+		float d = std::max(0.0f, glm::length(c - camPos) - r);
+		for(int k = 0; k < I[i]->NTx; k++) {
+			BP->textureStreamer.markUsed(T[I[i]->Tid[k]], d);
+		}
+	}
+}
+
 void Scene::populateCommandBuffer(VkCommandBuffer commandBuffer, int passId, int currentImage) {
 	if(passId >= Npasses) {
 		std::cout << "Scene Error: requested a pass too high in scene : " << passId << " >= " << Npasses << "\n";
@@ -469,7 +566,7 @@ void Scene::populateCommandBuffer(VkCommandBuffer commandBuffer, int passId, int
 //std::cout << "Considering technique " << k << "\n";
 		for(int i = 0; i < TI[k].InstanceCount; i++) {
 			Pipeline *P = TI[k].T->PT[passId].P;
-			if(P != nullptr) {
+			if((P != nullptr) && TI[k].I[i].ready) {
 				P->bind(commandBuffer);
 
 //std::cout << "Drawing Instance " << i << "\n";
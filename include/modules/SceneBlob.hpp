@@ -0,0 +1,427 @@
+// This module contains the compiled (binary) scene format, and the SAX parser
+// that builds it from the scene .json file. It does not depend on Vulkan, so it
+// can be used by the scene compiler tool.
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <filesystem>
+#include <json.hpp>
+
+// Compiled scene (.fscn): a header, the arrays of fixed size records, and a
+// table of null terminated strings, referenced by offset. Models, textures
+// and assets are referenced by index, already resolved from their ids.
+const uint32_t SCENE_BLOB_VERSION = 1;
+
+// which transform fields an instance has
+enum SceneBlobTransform {SBT_MATRIX = 1, SBT_TRANSLATE = 2, SBT_EULER = 4, SBT_QUATERNION = 8, SBT_SCALE = 16};
+
+struct SceneBlobHeader {
+	char magic[4];			// "FSCN"
+	uint32_t version;
+	uint64_t sourceSize;	// of the .json it has been compiled from
+	int64_t sourceTime;
+	uint32_t size;
+	uint32_t assetCount, modelCount, textureCount, techniqueCount, instanceCount, textureRefCount;
+	uint32_t assets, models, textures, techniques, instances, textureRefs, strings;	// offsets
+};
+
+struct SceneBlobAsset {
+	uint32_t id, file;
+	uint32_t format;		// first letter of the format: 'O', 'G' or 'M'
+};
+
+struct SceneBlobModel {
+	uint32_t id, VD;
+	uint32_t model;			// file name, or model name inside the asset
+	uint32_t node;
+	int32_t asset;			// -1 if not from an asset file
+	int32_t meshId;
+	uint32_t format;		// 'A', 'O', 'G' or 'M'
+};
+
+struct SceneBlobTexture {
+	uint32_t id, file;
+	uint32_t format;		// 'C' or 'D'
+	uint32_t stream;
+};
+
+struct SceneBlobTechnique {
+	uint32_t technique;
+	uint32_t firstInstance, instanceCount;
+};
+
+struct SceneBlobInstance {
+	uint32_t id;
+	int32_t model;
+	uint32_t firstTexture, textureCount;	// in the texture references
+	uint32_t flags;							// SceneBlobTransform
+	float transform[16];					// as written in the .json file
+	float translate[3];
+	float eulerAngles[3];
+	float quaternion[4];
+	float scale[3];
+};
+
+class SceneBlob {
+	public:
+	std::vector<unsigned char> data;
+
+	// the .fscn file compiled from a .json scene
+	static std::string compiledName(std::string jsonFile);
+	// loads a compiled scene, if it is up to date with its source (when present)
+	bool load(std::string file, std::string source);
+	// parses a .json scene (in SAX mode) into the compiled format
+	bool compile(std::string jsonFile);
+	bool save(std::string file);
+	// checks every offset, count and index of the loaded data
+	bool validate();
+
+	const SceneBlobHeader *header() {return (const SceneBlobHeader *)data.data();}
+	const SceneBlobAsset *assets() {return (const SceneBlobAsset *)(data.data() + header()->assets);}
+	const SceneBlobModel *models() {return (const SceneBlobModel *)(data.data() + header()->models);}
+	const SceneBlobTexture *textures() {return (const SceneBlobTexture *)(data.data() + header()->textures);}
+	const SceneBlobTechnique *techniques() {return (const SceneBlobTechnique *)(data.data() + header()->techniques);}
+	const SceneBlobInstance *instances() {return (const SceneBlobInstance *)(data.data() + header()->instances);}
+	const int32_t *textureRefs() {return (const int32_t *)(data.data() + header()->textureRefs);}
+	const char *str(uint32_t offset) {return (const char *)(data.data() + header()->strings + offset);}
+};
+
+#ifdef SCENEBLOB_IMPLEMENTATION
+
+// the values of a field of an object, as needed by the scene records
+struct SceneBlobField {
+	std::string s;
+	std::vector<std::string> strs;
+	std::vector<double> nums;
+	bool b = false;
+};
+typedef std::unordered_map<std::string, SceneBlobField> SceneBlobRecord;
+
+// Collects the records of the scene without building the DOM of the file:
+// only the fields of the object currently being read are kept
+class SceneBlobSax : public nlohmann::json_sax<nlohmann::json> {
+	int depth = 0;
+	std::string section, curKey;
+	SceneBlobRecord record;
+
+	void field(const std::string &s) {record[curKey].s = s; record[curKey].strs.push_back(s);}
+	void field(double n) {record[curKey].nums.push_back(n);}
+
+	public:
+	std::vector<SceneBlobRecord> assets, models, textures;
+	std::vector<std::string> techniques;
+	std::vector<std::vector<SceneBlobRecord>> elements;
+
+	bool null() override {return true;}
+	bool boolean(bool val) override {record[curKey].b = val; return true;}
+	bool number_integer(number_integer_t val) override {field((double)val); return true;}
+	bool number_unsigned(number_unsigned_t val) override {field((double)val); return true;}
+	bool number_float(number_float_t val, const string_t &) override {field((double)val); return true;}
+	bool string(string_t &val) override {
+		if((section == "instances") && (depth == 3) && (curKey == "technique")) {
+			techniques.back() = val;
+		} else {
+			field(val);
+		}
+		return true;
+	}
+	bool binary(binary_t &) override {return true;}
+	bool start_object(std::size_t) override {
+		depth++;
+		if((section == "instances") && (depth == 3)) {
+			techniques.push_back("");
+			elements.push_back({});
+		}
+		record.clear();
+		return true;
+	}
+	bool end_object() override {
+		if((depth == 3) && (section == "assetfiles")) assets.push_back(std::move(record));
+		if((depth == 3) && (section == "models")) models.push_back(std::move(record));
+		if((depth == 3) && (section == "textures")) textures.push_back(std::move(record));
+		if((depth == 5) && (section == "instances")) elements.back().push_back(std::move(record));
+		record.clear();
+		depth--;
+		return true;
+	}
+	bool start_array(std::size_t) override {depth++; return true;}
+	bool end_array() override {depth--; return true;}
+	bool key(string_t &val) override {
+		if(depth == 1) {
+			section = val;
+		}
+		curKey = val;
+		return true;
+	}
+	bool parse_error(std::size_t pos, const std::string &, const nlohmann::detail::exception &ex) override {
+		std::cout << "Scene Error: " << ex.what() << " at byte " << pos << "\n";
+		return false;
+	}
+};
+
+// Appends the records and the string table to a blob
+class SceneBlobWriter {
+	std::string strings;
+	std::unordered_map<std::string, uint32_t> stringIds;
+
+	public:
+	std::vector<SceneBlobAsset> assets;
+	std::vector<SceneBlobModel> models;
+	std::vector<SceneBlobTexture> textures;
+	std::vector<SceneBlobTechnique> techniques;
+	std::vector<SceneBlobInstance> instances;
+	std::vector<int32_t> textureRefs;
+
+	uint32_t str(const std::string &s) {
+		auto el = stringIds.find(s);
+		if(el != stringIds.end()) return el->second;
+		uint32_t off = strings.size();
+		strings.append(s);
+		strings.push_back('\0');
+		stringIds[s] = off;
+		return off;
+	}
+
+	template <class T>
+	static void append(std::vector<unsigned char> &data, const std::vector<T> &v, uint32_t &offset) {
+		offset = data.size();
+		data.resize(data.size() + v.size() * sizeof(T));
+		if(v.size() > 0) {
+			memcpy(data.data() + offset, v.data(), v.size() * sizeof(T));
+		}
+	}
+
+	void write(std::vector<unsigned char> &data, uint64_t sourceSize, int64_t sourceTime) {
+		SceneBlobHeader H{};
+		memcpy(H.magic, "FSCN", 4);
+		H.version = SCENE_BLOB_VERSION;
+		H.sourceSize = sourceSize;
+		H.sourceTime = sourceTime;
+		H.assetCount = assets.size();
+		H.modelCount = models.size();
+		H.textureCount = textures.size();
+		H.techniqueCount = techniques.size();
+		H.instanceCount = instances.size();
+		H.textureRefCount = textureRefs.size();
+
+		data.assign(sizeof(H), 0);
+		append(data, assets, H.assets);
+		append(data, models, H.models);
+		append(data, textures, H.textures);
+		append(data, techniques, H.techniques);
+		append(data, instances, H.instances);
+		append(data, textureRefs, H.textureRefs);
+		H.strings = data.size();
+		data.insert(data.end(), strings.begin(), strings.end());
+		H.size = data.size();
+		memcpy(data.data(), &H, sizeof(H));
+	}
+};
+
+static bool getSceneSourceStamp(std::string source, uint64_t &size, int64_t &time) {
+	std::error_code ec;
+	size = std::filesystem::file_size(source, ec);
+	if(ec) return false;
+	auto t = std::filesystem::last_write_time(source, ec);
+	if(ec) return false;
+	time = (int64_t)t.time_since_epoch().count();
+	return true;
+}
+
+std::string SceneBlob::compiledName(std::string jsonFile) {
+	size_t dot = jsonFile.rfind('.');
+	return ((dot == std::string::npos) ? jsonFile : jsonFile.substr(0, dot)) + ".fscn";
+}
+
+bool SceneBlob::load(std::string file, std::string source) {
+	std::ifstream ifs(file, std::ios::binary | std::ios::ate);
+	if(!ifs.is_open()) return false;
+	data.resize(ifs.tellg());
+	ifs.seekg(0);
+	ifs.read((char *)data.data(), data.size());
+	ifs.close();
+
+	bool valid = validate();
+	if(!valid) {
+		std::cout << "The compiled scene " << file << " is not valid, it will be compiled again\n";
+	}
+	// a compiled scene older than its source is ignored
+	uint64_t size;
+	int64_t time;
+	if(valid && getSceneSourceStamp(source, size, time)) {
+		valid = (header()->sourceSize == size) && (header()->sourceTime == time);
+	}
+	if(!valid) {
+		data.clear();
+	}
+	return valid;
+}
+
+bool SceneBlob::validate() {
+	SceneBlobHeader H;
+	if(data.size() < sizeof(H)) return false;
+	memcpy(&H, data.data(), sizeof(H));
+	if((memcmp(H.magic, "FSCN", 4) != 0) || (H.version != SCENE_BLOB_VERSION) ||
+	   (H.size != data.size()) || (H.strings < sizeof(H)) || (H.strings > H.size)) return false;
+
+	// the arrays lie between the header and the strings, aligned to their fields
+	auto inside = [&H](uint32_t offset, uint32_t count, size_t recSize) {
+		return (offset >= sizeof(H)) && (offset % 4 == 0) &&
+			   (offset + (uint64_t)count * recSize <= H.strings);
+	};
+	if(!inside(H.assets, H.assetCount, sizeof(SceneBlobAsset)) ||
+	   !inside(H.models, H.modelCount, sizeof(SceneBlobModel)) ||
+	   !inside(H.textures, H.textureCount, sizeof(SceneBlobTexture)) ||
+	   !inside(H.techniques, H.techniqueCount, sizeof(SceneBlobTechnique)) ||
+	   !inside(H.instances, H.instanceCount, sizeof(SceneBlobInstance)) ||
+	   !inside(H.textureRefs, H.textureRefCount, sizeof(int32_t))) return false;
+
+	// strings must start in the table, and the table must end with a terminator
+	uint32_t stringsSize = H.size - H.strings;
+	if((stringsSize > 0) && (data[H.size - 1] != '\0')) return false;
+	auto isStr = [stringsSize](uint32_t offset) {return offset < stringsSize;};
+
+	const SceneBlobAsset *as = assets();
+	for(uint32_t k = 0; k < H.assetCount; k++) {
+		if(!isStr(as[k].id) || !isStr(as[k].file)) return false;
+	}
+	const SceneBlobModel *ms = models();
+	for(uint32_t k = 0; k < H.modelCount; k++) {
+		if(!isStr(ms[k].id) || !isStr(ms[k].VD) || !isStr(ms[k].model) || !isStr(ms[k].node) ||
+		   (ms[k].asset < -1) || (ms[k].asset >= (int64_t)H.assetCount) ||
+		   ((ms[k].format == 'A') && (ms[k].asset < 0))) return false;
+	}
+	const SceneBlobTexture *ts = textures();
+	for(uint32_t k = 0; k < H.textureCount; k++) {
+		if(!isStr(ts[k].id) || !isStr(ts[k].file)) return false;
+	}
+	const SceneBlobTechnique *pis = techniques();
+	for(uint32_t k = 0; k < H.techniqueCount; k++) {
+		if(!isStr(pis[k].technique) ||
+		   ((uint64_t)pis[k].firstInstance + pis[k].instanceCount > H.instanceCount)) return false;
+	}
+	const SceneBlobInstance *is = instances();
+	for(uint32_t k = 0; k < H.instanceCount; k++) {
+		if(!isStr(is[k].id) || (is[k].model < 0) || (is[k].model >= (int64_t)H.modelCount) ||
+		   ((uint64_t)is[k].firstTexture + is[k].textureCount > H.textureRefCount)) return false;
+	}
+	const int32_t *refs = textureRefs();
+	for(uint32_t k = 0; k < H.textureRefCount; k++) {
+		if((refs[k] < 0) || (refs[k] >= (int64_t)H.textureCount)) return false;
+	}
+	return true;
+}
+
+bool SceneBlob::compile(std::string jsonFile) {
+	std::ifstream ifs(jsonFile);
+	if(!ifs.is_open()) {
+		std::cout << "Error! Scene file >" << jsonFile << "< not found!\n";
+		return false;
+	}
+	SceneBlobSax SX;
+	if(!nlohmann::json::sax_parse(ifs, &SX)) {
+		return false;
+	}
+	ifs.close();
+
+	SceneBlobWriter W;
+	std::unordered_map<std::string, int> assetIds, modelIds, textureIds;
+	auto num = [](SceneBlobRecord &R, const char *k, int i) {
+		return (R[k].nums.size() > i) ? R[k].nums[i] : 0.0;
+	};
+	auto format = [](SceneBlobRecord &R) {
+		return (uint32_t)(R["format"].s.size() > 0 ? R["format"].s[0] : ' ');
+	};
+
+	for(auto &R : SX.assets) {
+		assetIds[R["id"].s] = W.assets.size();
+		W.assets.push_back({W.str(R["id"].s), W.str(R["file"].s), format(R)});
+	}
+	for(auto &R : SX.models) {
+		SceneBlobModel BM{};
+		BM.id = W.str(R["id"].s);
+		BM.VD = W.str(R["VD"].s);
+		BM.model = W.str(R["model"].s);
+		BM.node = W.str(R["node"].s);
+		BM.format = format(R);
+		BM.asset = -1;
+		BM.meshId = (int32_t)num(R, "meshId", 0);
+		if(BM.format == 'A') {
+			auto el = assetIds.find(R["asset"].s);
+			if(el == assetIds.end()) {
+				std::cout << "Scene Error: model " << R["id"].s << " refers to unknown asset " << R["asset"].s << "\n";
+				return false;
+			}
+			BM.asset = el->second;
+		}
+		modelIds[R["id"].s] = W.models.size();
+		W.models.push_back(BM);
+	}
+	for(auto &R : SX.textures) {
+		textureIds[R["id"].s] = W.textures.size();
+		W.textures.push_back({W.str(R["id"].s), W.str(R["texture"].s), format(R), R["stream"].b ? 1u : 0u});
+	}
+	for(int k = 0; k < SX.techniques.size(); k++) {
+		W.techniques.push_back({W.str(SX.techniques[k]), (uint32_t)W.instances.size(), (uint32_t)SX.elements[k].size()});
+		for(auto &R : SX.elements[k]) {
+			SceneBlobInstance BI{};
+			BI.id = W.str(R["id"].s);
+			auto el = modelIds.find(R["model"].s);
+			if(el == modelIds.end()) {
+				std::cout << "Scene Error: instance " << R["id"].s << " refers to unknown model " << R["model"].s << "\n";
+				return false;
+			}
+			BI.model = el->second;
+			BI.firstTexture = W.textureRefs.size();
+			BI.textureCount = R["texture"].strs.size();
+			for(auto &t : R["texture"].strs) {
+				auto tel = textureIds.find(t);
+				if(tel == textureIds.end()) {
+					std::cout << "Scene Error: instance " << R["id"].s << " refers to unknown texture " << t << "\n";
+					return false;
+				}
+				W.textureRefs.push_back(tel->second);
+			}
+
+			struct {const char *name; SceneBlobTransform flag; float *dst; int n;} TF[] = {
+				{"transform", SBT_MATRIX, BI.transform, 16},
+				{"translate", SBT_TRANSLATE, BI.translate, 3},
+				{"eulerAngles", SBT_EULER, BI.eulerAngles, 3},
+				{"quaternion", SBT_QUATERNION, BI.quaternion, 4},
+				{"scale", SBT_SCALE, BI.scale, 3}};
+			for(auto &F : TF) {
+				auto fel = R.find(F.name);
+				if((fel != R.end()) && (fel->second.nums.size() >= F.n)) {
+					BI.flags |= F.flag;
+					for(int h = 0; h < F.n; h++) {
+						F.dst[h] = (float)fel->second.nums[h];
+					}
+				}
+			}
+			W.instances.push_back(BI);
+		}
+	}
+
+	uint64_t size = 0;
+	int64_t time = 0;
+	getSceneSourceStamp(jsonFile, size, time);
+	W.write(data, size, time);
+	return true;
+}
+
+bool SceneBlob::save(std::string file) {
+	std::ofstream ofs(file, std::ios::binary);
+	if(!ofs.is_open()) {
+		std::cout << "Cannot write the compiled scene: " << file << "\n";
+		return false;
+	}
+	ofs.write((const char *)data.data(), data.size());
+	return true;
+}
+
+#endif
@@ -16,13 +16,28 @@
 #include <chrono>
 #include <unordered_map>
 #include <map>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <atomic>
+#include <filesystem>
+
+#ifndef _WIN32
+// to memory map the baked meshes
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 #ifdef STARTER_IMPLEMENTATION
 // to allow splitting header and implementation
 #define TINYOBJLOADER_IMPLEMENTATION
 #define STB_IMAGE_IMPLEMENTATION
 #define STB_IMAGE_WRITE_IMPLEMENTATION
-#define SINFL_IMPLEMENTATION
 #define TINYGLTF_IMPLEMENTATION
 #endif
 
@@ -34,6 +49,9 @@
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_precision.hpp>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/transform2.hpp>
 
 
@@ -50,8 +68,8 @@
 // AES encription, to load MGCG files
 #include <plusaes.hpp>
 
-// Unzip library, to load MGCG files
-#include <sinfl.h>
+// streamed decryption and inflation of the MGCG files
+#include "Inflate.hpp"
 
 // use GLFW to support windowing
 #define GLFW_INCLUDE_VULKAN
@@ -108,6 +126,29 @@ std::vector<char> readFile(const std::string& filename);
 
 class BaseProject;
 
+// GPU memory accounting: every allocation done by createBuffer / createImage
+// is tagged with one of these
+enum MemoryCategory {MEM_OTHER, MEM_MESH, MEM_TEXTURE, MEM_UNIFORM, MEM_TEXT, MEM_ATTACHMENT, MEM_STAGING, MEM_CATEGORIES};
+
+struct MemoryAllocation {
+	VkDeviceSize size;
+	MemoryCategory category;
+	uint32_t heap;
+};
+
+struct MemoryStats {
+	VkDeviceSize used[MEM_CATEGORIES] = {};
+	VkDeviceSize peak[MEM_CATEGORIES] = {};
+	int allocations[MEM_CATEGORIES] = {};
+	// per heap values. Usage and budget come from VK_EXT_memory_budget when
+	// available, otherwise usage is our own count and budget is the heap size
+	bool hasBudget = false;
+	std::vector<VkDeviceSize> heapSize;
+	std::vector<VkDeviceSize> heapUsage;
+	std::vector<VkDeviceSize> heapBudget;
+	std::vector<bool> heapDeviceLocal;
+};
+
 struct VertexBindingDescriptorElement {
 	uint32_t binding;
 	uint32_t stride;
@@ -128,6 +169,7 @@ struct VertexDescriptorElement {
 struct VertexComponent {
 	bool hasIt;
 	uint32_t offset;
+	VkFormat format;
 };
 
 struct VertexDescriptor {
@@ -148,6 +190,13 @@ struct VertexDescriptor {
  	void init(BaseProject *bp, std::vector<VertexBindingDescriptorElement> B, std::vector<VertexDescriptorElement> E);
 	void cleanup();
 
+	// write a component into a vertex, packing it if the layout asks for it
+	void storeNormal(unsigned char *vertex, glm::vec3 n);
+	void storeTangent(unsigned char *vertex, glm::vec4 t);
+	void storeUV(unsigned char *vertex, glm::vec2 uv);
+	void storeJointIndex(unsigned char *vertex, glm::uvec4 j);
+	void storeJointWeight(unsigned char *vertex, glm::vec4 w);
+
 	std::vector<VkVertexInputBindingDescription> getBindingDescription();
 	std::vector<VkVertexInputAttributeDescription>
 						getAttributeDescriptions();
@@ -157,6 +206,75 @@ enum ModelType {OBJ, GLTF, MGCG};
 
 class AssetFile;
 
+// Read only view of a whole file: memory mapped where available, read into
+// memory otherwise
+class MappedFile {
+	const unsigned char *ptr = nullptr;
+	size_t len = 0;
+	std::vector<unsigned char> buffer;
+
+	public:
+	bool open(std::string file);
+	const unsigned char *data() {return ptr;}
+	size_t size() {return len;}
+	void close();
+	~MappedFile() {close();}
+};
+
+// Baked meshes (.fmesh): the vertices already interleaved for a vertex layout
+// and the indices in the format used by the GPU, followed by the vertex and the
+// index data, and by the table of the other files read by the import (the
+// buffers of a .gltf): each entry is their size, time and '\0' terminated name.
+// Bakes are regenerated when the source, these files or the layout change.
+const uint32_t FMESH_VERSION = 2;
+const std::string FMESH_DIR = "cache/meshes/";
+
+struct FMeshHeader {
+	char magic[4];			// "FMSH"
+	uint32_t version;
+	uint64_t layoutHash;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t stride;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t indexSize;		// 2 or 4 bytes
+	uint32_t depCount;		// entries of the table of the other files
+	uint32_t depBytes;
+	float bounds[4];
+	float Wm[16];
+};
+
+// Mips of a streaming texture, from the top to the tail, computed the first
+// time it is loaded: the RGBA8 levels follow this header, so that the streamer
+// reads only the level it needs.
+const uint32_t FMIP_VERSION = 1;
+const std::string FMIP_DIR = "cache/textures/";
+
+struct FMipHeader {
+	char magic[4];			// "FMIP"
+	uint32_t version;
+	uint64_t sourceSize;
+	int64_t sourceTime;
+	uint32_t width;			// of the top level
+	uint32_t height;
+	uint32_t levels;
+	uint32_t pad;
+};
+
+// Pipeline cache saved between runs: the driver data follows this header, and
+// it is discarded when it has been produced by another device or driver.
+const std::string PIPELINE_CACHE_FILE = "cache/pipelines.bin";
+
+struct PipelineCacheHeader {
+	char magic[4];			// "FPLC"
+	uint32_t vendorID;
+	uint32_t deviceID;
+	uint32_t driverVersion;
+	uint8_t uuid[VK_UUID_SIZE];
+	uint64_t dataSize;
+};
+
 class Model {
 	BaseProject *BP;
 	
@@ -164,10 +282,24 @@ class Model {
 	VkDeviceMemory vertexBufferMemory;
 	VkBuffer indexBuffer;
 	VkDeviceMemory indexBufferMemory;
+	VkIndexType indexType = VK_INDEX_TYPE_UINT32;
 	VertexDescriptor *VD;
+	bool hasBounds = false;
+	glm::vec4 bounds;
+
+	// baked mesh waiting for upload(), its data are copied directly from the file
+	MappedFile *baked = nullptr;
+	FMeshHeader bakedHeader;
+	static uint64_t layoutHash(VertexDescriptor *VD);
+	static std::string bakedFileName(std::string key, uint64_t layout);
+	std::vector<std::string> bakeDeps;	// files read by the import, besides the source
+	bool loadBaked(std::string source, std::string key);
+	void saveBaked(std::string source, std::string key);
+	void extractFromAsset(AssetFile *AF, std::string AN, int Mid, std::string NN);
 
 	public:
 	glm::mat4 Wm;
+	MemoryCategory memCategory = MEM_MESH;
 	std::vector<unsigned char> vertices{};
 	std::vector<uint32_t> indices{};
 	void loadModelOBJ(std::string file);
@@ -176,14 +308,24 @@ class Model {
 	void makeGLTFwm(const tinygltf::Node *N);
 	void makeGLTFMesh(tinygltf::Model *M, const tinygltf::Primitive *Prm);
 	void loadModelGLTF(std::string file, bool encoded);
+	void optimizeMesh();
 	void createIndexBuffer();
 	void createVertexBuffer();
 
 	void init(BaseProject *bp, VertexDescriptor *VD, std::string file, ModelType MT);
 	void initFromAsset(BaseProject *bp, VertexDescriptor *VD, AssetFile *AF, std::string AN, int Mid = 0, std::string NN = "");
+	// init() and initFromAsset() split in the CPU part (no Vulkan calls, can run
+	// on a worker thread) and the GPU upload (main thread)
+	void load(BaseProject *bp, VertexDescriptor *VD, std::string file, ModelType MT);
+	void loadFromAsset(BaseProject *bp, VertexDescriptor *VD, AssetFile *AF, std::string AN, int Mid = 0, std::string NN = "");
+	// as above, but the asset file is parsed only if the mesh has not been baked yet
+	void initFromAsset(BaseProject *bp, VertexDescriptor *VD, std::string assetFile, ModelType AT, std::string AN, int Mid = 0, std::string NN = "");
+	void loadFromAsset(BaseProject *bp, VertexDescriptor *VD, std::string assetFile, ModelType AT, std::string AN, int Mid = 0, std::string NN = "");
+	void upload();
 	void initMesh(BaseProject *bp, VertexDescriptor *VD, bool printDebug = true);
 	void cleanup();
   	void bind(VkCommandBuffer commandBuffer);
+	glm::vec4 getBoundingSphere();	// center (xyz) and radius (w), in local space
 };
 
 class AssetFile {
@@ -200,6 +342,11 @@ class AssetFile {
 	std::unordered_map<std::string, const tinyobj::shape_t *> OBJmeshes;
 	
 	ModelType type;
+	std::string fileName;
+
+	// parsed documents, shared by all the loaders
+	static std::mutex cacheMtx;
+	static std::unordered_map<std::string, std::shared_future<AssetFile *>> cache;
 	
 	public:
 	void initGLTF(std::string file);
@@ -207,7 +354,14 @@ class AssetFile {
 	void init(std::string file, ModelType MT);
 	ModelType getType() {return type;}
 	tinygltf::Model *getGLTFmodel() {return &model;}
+	void printInfo();
 	void cleanup();
+
+	// Returns the parsed file, reading it only the first time it is requested
+	// (thread safe). The returned assets are released by clearCache().
+	static bool verbose;	// prints the content of each parsed document
+	static AssetFile *get(std::string file, ModelType MT);
+	static void clearCache();
 };
 
 struct Texture {
@@ -236,6 +390,161 @@ struct Texture {
 	void initCubic(BaseProject *bp, std::vector<std::string>, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB);
 	VkDescriptorImageInfo getViewAndSampler();
 	void cleanup();
+
+	// Streaming: only a small mip tail is loaded at init, the TextureStreamer
+	// of the application raises (or lowers) the resident mips at run time.
+	// Mip numbers refer to the full resolution chain.
+	bool streaming = false;
+	std::string streamFile;
+	VkFormat streamFmt;
+	int fullWidth, fullHeight;
+	uint32_t fullMipLevels;
+	uint32_t tailMip;
+	uint32_t residentMip;
+	uint32_t wantedMip;
+	uint32_t pendingMip;
+	bool streamPending = false;
+	uint64_t lastUsedFrame = 0;
+	void initStreaming(BaseProject *bp, std::string file, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB, int tailSize = 64);
+	void createTextureImageFromPixels(const unsigned char *pixels, int w, int h, VkFormat Fmt);
+	VkDeviceSize mipChainBytes(uint32_t firstMip);
+
+	// FMIP cache of the streamed mips, empty if it could not be written
+	std::string mipFile;
+	void setStreamSize(int w, int h, int tailSize);
+	bool loadMipCache(int tailSize);
+	void bakeMips(const unsigned char *pixels);
+	bool readMip(uint32_t mip, std::vector<unsigned char> &pixels, int &w, int &h);
+
+	// init() split in the file decoding (no Vulkan calls, can run on a worker
+	// thread) and the GPU upload (main thread)
+	std::string decodedFile;
+	std::vector<unsigned char> decodedPixels;
+	int decodedWidth, decodedHeight, decodedChannels;
+	void decode(std::string file, bool stream = false, int tailSize = 64);
+	void upload(BaseProject *bp, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB);
+
+	// 1x1 image used while the texture is still loading: upload() replaces it
+	// in all the descriptor sets that were created with it
+	bool placeholder = false;
+	void initPlaceholder(BaseProject *bp, VkFormat Fmt = VK_FORMAT_R8G8B8A8_SRGB);
+};
+
+// Collects timed scopes and saves them as a chrome://tracing (JSON) file.
+// Nothing is recorded unless enable() has been called. The trace is written
+// when the startup and the background loads it started (hold()) have all
+// called release().
+class Profiler {
+	struct Event {
+		std::string name;
+		std::string cat;
+		long long start, dur;
+		int tid;
+	};
+	static std::mutex mtx;
+	static std::vector<Event> events;
+	static std::unordered_map<std::thread::id, int> tids;
+	static std::chrono::high_resolution_clock::time_point origin;
+	static std::atomic<int> holds;
+
+	public:
+	static std::atomic<bool> enabled;
+	static std::string traceFile;
+	static void enable(std::string file = "startup_trace.json");
+	static long long now();		// microseconds since the start of the program
+	static void record(const std::string &name, const char *cat, long long start, long long end);
+	static void hold();
+	static void release();
+	static void write();
+};
+
+// Times the enclosing scope (or until end(), or next() that starts a new one)
+class ProfileScope {
+	std::string name;
+	const char *cat;
+	long long start;
+	bool running;
+
+	public:
+	ProfileScope(std::string _name, const char *_cat = "startup");
+	~ProfileScope() {end();}
+	void end();
+	void next(std::string _name);
+};
+
+// Fixed set of worker threads executing queued jobs
+class ThreadPool {
+	std::vector<std::thread> workers;
+	std::deque<std::function<void()>> jobs;
+	std::mutex mtx;
+	std::condition_variable cv;
+	bool quit = false;
+
+	void workerLoop();
+
+	public:
+	void init(int nThreads = 0);	// 0: one per core, except the main thread
+	std::future<void> submit(std::function<void()> job);
+	int size() {return workers.size();}
+	void cleanup();
+	~ThreadPool() {cleanup();}
+};
+
+struct TextureStreamRequest {
+	Texture *T;
+	uint32_t mip;
+	std::vector<unsigned char> pixels;
+	int w, h;
+};
+
+// Background loader for streaming textures. The application reports which
+// textures are used (and how far they are), update() is called once per
+// frame by the main loop.
+struct TextureStreamer {
+	BaseProject *BP = nullptr;
+	VkDeviceSize budget = 256 * 1024 * 1024;
+	float fullResDistance = 8.0f;	// closer than this, the top mip is wanted
+
+	std::vector<Texture *> textures;
+	uint64_t frame = 0;
+
+	void add(BaseProject *bp, Texture *T);
+	void markUsed(Texture *T, float distance);
+	void update();
+	void imageAcquired(int imageIndex);
+	// swaps the image of a texture that was drawn, as done for the streamed
+	// mips (the sampler is replaced too, if given)
+	void retire(Texture *T, VkImage image, VkDeviceMemory memory, VkImageView view, VkSampler sampler = VK_NULL_HANDLE);
+	void cleanup();
+	VkDeviceSize getResidentBytes();
+
+	private:
+	// image replaced by a streamed one: the descriptor sets of each swap chain
+	// image are re-pointed when that image is no longer in flight, and the old
+	// image is released MAX_FRAMES_IN_FLIGHT frames after the last of them
+	struct Retired {
+		Texture *T;
+		VkImage image;
+		VkDeviceMemory memory;
+		VkImageView view;
+		VkSampler sampler;
+		std::vector<bool> rebound;
+		uint64_t freeFrame;
+	};
+	std::vector<Retired> retired;
+	void release(Retired &R);
+	void releaseRetired();
+
+	std::thread worker;
+	std::mutex mtx;
+	std::condition_variable cv;
+	std::deque<TextureStreamRequest> pending;
+	std::vector<TextureStreamRequest> ready;
+	bool quit = false;
+
+	void request(Texture *T, uint32_t mip);
+	bool makeRoom(VkDeviceSize needed, VkDeviceSize &resident);
+	void workerLoop();
 };
 
 struct DescriptorSetLayoutBinding {
@@ -346,6 +655,10 @@ struct RenderPass {
 	void end(VkCommandBuffer commandBuffer);
 	void cleanup();
 	void destroy();
+	// recreates only the attachments and the framebuffers: the render pass,
+	// and the pipelines created for it, are kept
+	void resize(int w, int h);
+	bool followsSwapChain();
 	static std::vector <AttachmentProperties> *getStandardAttchmentsProperties(StockAttchmentsConfiguration cfg, BaseProject *BP);
 	static std::vector<VkSubpassDependency> *getStandardDependencies(StockAttchmentsDependencies cfg);
 	
@@ -371,6 +684,7 @@ struct Pipeline {
 	VkPrimitiveTopology topology;
 	
 	VertexDescriptor *VD;
+	std::string name;
   	
   	void init(BaseProject *bp, VertexDescriptor *vd,
 			  const std::string& VertShader, const std::string& FragShader,
@@ -389,8 +703,73 @@ struct Pipeline {
 	void cleanup();
 };
 
+// Hands out descriptor sets from a chain of pools: when the current pool
+// is exhausted the next one is tried, or a new, larger one is created.
+// The capacity left in each pool is tracked, since a Vulkan 1.0 device
+// without VK_KHR_maintenance1 is not required to report a full pool with
+// VK_ERROR_OUT_OF_POOL_MEMORY. Transient allocators are reset as a whole
+// instead of freeing single sets.
+struct DescriptorAllocator {
+	BaseProject *BP = nullptr;
+	bool transient = false;
+	uint32_t setsPerPool = 64;
+	uint32_t uniformsPerSet = 2;	// ratios used to size the growth pools
+	uint32_t texturesPerSet = 4;
+
+	struct Pool {
+		VkDescriptorPool pool;
+		uint32_t sets, uniforms, textures;	// still available
+		uint32_t maxSets, maxUniforms, maxTextures;
+	};
+	std::vector<Pool> pools;
+	int current = 0;
+
+	void init(BaseProject *bp, bool isTransient, uint32_t sets, uint32_t uniforms, uint32_t textures);
+	VkDescriptorPool allocate(DescriptorSetLayout *DSL, uint32_t count, VkDescriptorSet *sets);
+	void free(DescriptorSetLayout *DSL, VkDescriptorPool pool, uint32_t count, VkDescriptorSet *sets);
+	void reset();
+	void cleanup();
+
+	private:
+	Pool createPool(uint32_t sets, uint32_t uniforms, uint32_t textures);
+	static void descriptorsNeeded(DescriptorSetLayout *DSL, uint32_t count, uint32_t &uniforms, uint32_t &textures);
+};
+
+// Descriptor sets that live a single frame, and their uniform blocks: both
+// are handed out from memory that is reset as a whole when the frame slot is
+// reused, so they can only be used by command buffers recorded again every
+// frame (see submitCommandBuffer())
+struct TransientDescriptors {
+	BaseProject *BP = nullptr;
+	DescriptorAllocator sets;
+
+	// host visible memory for the uniforms: a block twice as large is added
+	// when the last one is full, and reset() keeps only the largest
+	struct UniformBlock {
+		VkBuffer buffer;
+		VkDeviceMemory memory;
+		unsigned char *mapped;
+		VkDeviceSize size;
+	};
+	std::vector<UniformBlock> blocks;
+	VkDeviceSize used = 0;
+	VkDeviceSize alignment = 256;
+
+	void init(BaseProject *bp);
+	// uniforms holds the data of the uniform bindings, in the order of the layout
+	VkDescriptorSet allocate(DescriptorSetLayout *DSL, const std::vector<const void *> &uniforms,
+							 const std::vector<VkDescriptorImageInfo> &VaSs);
+	void reset();
+	void cleanup();
+
+	private:
+	VkDescriptorBufferInfo allocateUniform(const void *src, VkDeviceSize size);
+	void destroyBlock(UniformBlock &B);
+};
+
 struct DescriptorSet {
 	BaseProject *BP;
+	VkDescriptorPool pool = VK_NULL_HANDLE;
 
 	std::vector<std::vector<VkBuffer>> uniformBuffers;
 	std::vector<std::vector<VkDeviceMemory>> uniformBuffersMemory;
@@ -407,6 +786,18 @@ struct DescriptorSet {
 };
 
 
+// a combined image sampler written in a descriptor set, so that streamed
+// textures can be re-pointed to a new image view
+struct DescriptorTextureBinding {
+	VkDescriptorSet set;
+	uint32_t binding;
+	uint32_t element;
+	VkDescriptorImageInfo info;
+	int image;		// swap chain image of the set
+};
+
+// Initial size of the descriptor pool (per swap chain image): the pool
+// grows on demand, so this is only a hint to avoid creating more pools
 struct PoolSizes {
 	int uniformBlocksInPool = 0;
 	int texturesInPool = 0;
@@ -428,6 +819,7 @@ struct NamedCommandBuffer {
 
 	NamedCommandBuffersStates state;
 	std::vector<bool> inQueue;
+	bool everyFrame = false;	// recorded again each time it is drawn
 };
 
 struct NamedCommandBufferVersions {
@@ -445,6 +837,10 @@ class BaseProject {
 	friend class Pipeline;
 	friend class DescriptorSetLayout;
 	friend class DescriptorSet;
+	friend class DescriptorAllocator;
+	friend struct TransientDescriptors;
+	friend class TextureStreamer;
+	friend struct TextMaker;
 
 public:
 	virtual void setWindowParameters() = 0;
@@ -452,6 +848,14 @@ public:
 
 	PoolSizes DPSZs;
 
+	TextureStreamer textureStreamer;
+
+	// JSON memory report written on exit, empty to disable
+	std::string memoryReportFile = "memory_report.json";
+	void getMemoryStats(MemoryStats &MS);
+	static const char *memoryCategoryName(MemoryCategory C);
+	void writeMemoryReport(std::string file);
+
 protected:
 	uint32_t windowWidth;
 	uint32_t windowHeight;
@@ -479,17 +883,42 @@ protected:
 	VkExtent2D swapChainExtent;
 	std::vector<VkImageView> swapChainImageViews;
 		
- 	VkDescriptorPool descriptorPool;
+ 	DescriptorAllocator descriptorAllocator;
+	// reset every time the frame slot is reused, for sets that live one frame
+	TransientDescriptors transientDescriptors[MAX_FRAMES_IN_FLIGHT];
 
 	VkDebugUtilsMessengerEXT debugMessenger;
 
+	VkPhysicalDeviceMemoryProperties memProperties;
+	bool hasMemoryBudget = false;
+	std::unordered_map<VkDeviceMemory, MemoryAllocation> memAllocations;
+	MemoryStats memStats;
+	void trackAllocation(VkDeviceMemory mem, VkDeviceSize size, uint32_t memoryType, MemoryCategory cat);
+	void freeMemory(VkDeviceMemory mem);
+
+	// render passes drawing to the swap chain, resized with it
+	std::vector<RenderPass *> swapChainPasses;
+
+	std::vector<DescriptorTextureBinding> textureBindings;
+	// image = -1: the sets of all the swap chain images
+	void rebindTextureView(VkImageView oldView, VkImageView newView, VkSampler newSampler = VK_NULL_HANDLE, int image = -1);
+
+	// shared by all the pipelines, loaded at start and saved at exit
+	VkPipelineCache pipelineCache = VK_NULL_HANDLE;
+	void createPipelineCache();
+	void savePipelineCache();
+	// creates independent pipelines in parallel
+	void createPipelines(RenderPass *RP, std::vector<Pipeline *> PL);
+
 	size_t currentFrame = 0;
 	bool framebufferResized = false;
+	bool rebuildPipelines = false;	// set by RebuildPipeline()
 
 	std::vector<VkSemaphore> imageAvailableSemaphores;
 	std::vector<VkSemaphore> renderFinishedSemaphores;
 	std::vector<VkFence> inFlightFences;
 	std::vector<VkFence> imagesInFlight;
+	std::vector<bool> staleImages;	// set by invalidateCommandBuffers()
 	
     void initWindow();
 
@@ -557,7 +986,7 @@ protected:
 				 VkImageTiling tiling, VkImageUsageFlags usage,
 				 VkImageCreateFlags cflags,
 				 VkMemoryPropertyFlags properties, VkImage& image,
-				 VkDeviceMemory& imageMemory);	
+				 VkDeviceMemory& imageMemory, MemoryCategory cat = MEM_OTHER);	
 	void generateMipmaps(VkImage image, VkFormat imageFormat,
 					 int32_t texWidth, int32_t texHeight,
 					 uint32_t mipLevels, int layerCount);
@@ -570,13 +999,25 @@ protected:
 	void endSingleTimeCommands(VkCommandBuffer commandBuffer);
 	void createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 				  VkMemoryPropertyFlags properties,
-				  VkBuffer& buffer, VkDeviceMemory& bufferMemory);
+				  VkBuffer& buffer, VkDeviceMemory& bufferMemory, MemoryCategory cat = MEM_OTHER);
 	uint32_t findMemoryType(uint32_t typeFilter,
 						VkMemoryPropertyFlags properties);
 	void createDescriptorPool();
 						
 	public:
-	void submitCommandBuffer(std::string name, int order, pNCBfunc populateNewCommandBuffer, void *params, pNCBfree onErase = nullptr);
+	// a set for the current frame only: it can be bound only by command
+	// buffers submitted with everyFrame
+	VkDescriptorSet allocateTransientDescriptorSet(DescriptorSetLayout *DSL, const std::vector<const void *> &uniforms,
+												   const std::vector<VkDescriptorImageInfo> &VaSs = {});
+
+	// everyFrame: the command buffer is recorded again each time it is
+	// drawn, so that it can use transient descriptor sets
+	void submitCommandBuffer(std::string name, int order, pNCBfunc populateNewCommandBuffer, void *params, pNCBfree onErase = nullptr,
+							 bool everyFrame = false);
+
+	// the command buffers of each image are recorded again the next time it
+	// is acquired, without waiting for the frames in flight
+	void invalidateCommandBuffers();
 
 	protected:
 	void removeBuffer(std::string name);
@@ -584,6 +1025,7 @@ protected:
 	void clearNamedCommandBuffer(NamedCommandBuffer *ncb);
 	void clearCommandBuffers();
 	void resetCommandBuffers();
+	void resetCommandBuffersForImage(int img);
 	void createSyncObjects();
 	void mainLoop();
 	void createCommandBuffer(NamedCommandBuffer *ncb, int imageIndex);
@@ -596,6 +1038,7 @@ protected:
 
 	void recreateSwapChain();
 	void cleanupSwapChain();
+	void pipelinesAndDescriptorSetsCleanupAll();
 	void cleanup();
 	void RebuildPipeline();
 	
@@ -770,8 +1213,14 @@ void BaseProject::run() {
 	windowResizable = GLFW_FALSE;
 
 	setWindowParameters();
-	initWindow();
-	initVulkan();
+	{
+		ProfileScope PS("initWindow");
+		initWindow();
+		PS.next("initVulkan");
+		initVulkan();
+	}
+	// the startup is over, the background loads may still be running
+	Profiler::release();
 	mainLoop();
 	cleanup();
 }
@@ -797,21 +1246,34 @@ void BaseProject::framebufferResizeCallback(GLFWwindow* window, int width, int h
 }
 
 void BaseProject::initVulkan() {
+	ProfileScope PS("createInstance");
 	createInstance();				
+	PS.next("setupDebugMessenger");
 	setupDebugMessenger();			
+	PS.next("createSurface");
 	createSurface();				
+	PS.next("pickPhysicalDevice");
 	pickPhysicalDevice();			
+	PS.next("createLogicalDevice");
 	createLogicalDevice();			
+	PS.next("createPipelineCache");
+	createPipelineCache();
+	PS.next("createSwapChain");
 	createSwapChain();				
 	createImageViews();				
 
+	PS.next("createCommandPool");
 	createCommandPool();			
+	PS.next("localInit");
 	localInit();
 
+	PS.next("createDescriptorPool");
 	createDescriptorPool();			
+	PS.next("pipelinesAndDescriptorSetsInit");
 	pipelinesAndDescriptorSetsInit();
 
 //		createCommandBuffers();			
+	PS.next("createSyncObjects");
 	createSyncObjects();			 
 }
 
@@ -1183,6 +1645,13 @@ void BaseProject::createLogicalDevice() {
 		queueCreateInfos.push_back(queueCreateInfo);
 	}
 	
+	vkGetPhysicalDeviceMemoryProperties(physicalDevice, &memProperties);
+	if(checkIfItHasExtension(VK_KHR_GET_PHYSICAL_DEVICE_PROPERTIES_2_EXTENSION_NAME) &&
+	   checkIfItHasDeviceExtension(physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME)) {
+		deviceExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+		hasMemoryBudget = true;
+	}
+	
 	VkPhysicalDeviceFeatures deviceFeatures{};
 	deviceFeatures.samplerAnisotropy = VK_TRUE;
 	deviceFeatures.sampleRateShading = VK_TRUE;
@@ -1408,7 +1877,7 @@ void BaseProject::createImage(uint32_t width, uint32_t height,
 				 VkImageTiling tiling, VkImageUsageFlags usage,
 				 VkImageCreateFlags cflags,
 				 VkMemoryPropertyFlags properties, VkImage& image,
-				 VkDeviceMemory& imageMemory) {		
+				 VkDeviceMemory& imageMemory, MemoryCategory cat) {		
 	VkImageCreateInfo imageInfo{};
 	imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
 	imageInfo.imageType = VK_IMAGE_TYPE_2D;
@@ -1443,6 +1912,7 @@ void BaseProject::createImage(uint32_t width, uint32_t height,
 							VK_SUCCESS) {
 		throw std::runtime_error("failed to allocate image memory!");
 	}
+	trackAllocation(imageMemory, allocInfo.allocationSize, allocInfo.memoryTypeIndex, cat);
 
 	vkBindImageMemory(device, image, imageMemory, 0);
 }
@@ -1650,7 +2120,7 @@ void BaseProject::endSingleTimeCommands(VkCommandBuffer commandBuffer) {
 
 void BaseProject::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 				  VkMemoryPropertyFlags properties,
-				  VkBuffer& buffer, VkDeviceMemory& bufferMemory) {
+				  VkBuffer& buffer, VkDeviceMemory& bufferMemory, MemoryCategory cat) {
 	VkBufferCreateInfo bufferInfo{};
 	bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
 	bufferInfo.size = size;
@@ -1679,6 +2149,7 @@ void BaseProject::createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
 		PrintVkError(result);
 		throw std::runtime_error("failed to allocate vertex buffer memory!");
 	}
+	trackAllocation(bufferMemory, allocInfo.allocationSize, allocInfo.memoryTypeIndex, cat);
 	
 	vkBindBufferMemory(device, buffer, bufferMemory, 0);
 }
@@ -1699,31 +2170,454 @@ uint32_t BaseProject::findMemoryType(uint32_t typeFilter,
 	throw std::runtime_error("failed to find suitable memory type!");
 }
 
+void BaseProject::trackAllocation(VkDeviceMemory mem, VkDeviceSize size, uint32_t memoryType, MemoryCategory cat) {
+	uint32_t heap = memProperties.memoryTypes[memoryType].heapIndex;
+	memAllocations[mem] = {size, cat, heap};
+	memStats.used[cat] += size;
+	memStats.allocations[cat]++;
+	if(memStats.used[cat] > memStats.peak[cat]) {
+		memStats.peak[cat] = memStats.used[cat];
+	}
+}
+
+void BaseProject::freeMemory(VkDeviceMemory mem) {
+	auto el = memAllocations.find(mem);
+	if(el != memAllocations.end()) {
+		memStats.used[el->second.category] -= el->second.size;
+		memStats.allocations[el->second.category]--;
+		memAllocations.erase(el);
+	}
+	vkFreeMemory(device, mem, nullptr);
+}
+
+const char *BaseProject::memoryCategoryName(MemoryCategory C) {
+	static const char *names[MEM_CATEGORIES] = {"other", "mesh", "texture", "uniform", "text", "attachment", "staging"};
+	return names[C];
+}
+
+void BaseProject::getMemoryStats(MemoryStats &MS) {
+	MS = memStats;
+	uint32_t nHeaps = memProperties.memoryHeapCount;
+	MS.heapSize.resize(nHeaps);
+	MS.heapUsage.assign(nHeaps, 0);
+	MS.heapBudget.resize(nHeaps);
+	MS.heapDeviceLocal.resize(nHeaps);
+	for(uint32_t i = 0; i < nHeaps; i++) {
+		MS.heapSize[i] = memProperties.memoryHeaps[i].size;
+		MS.heapBudget[i] = memProperties.memoryHeaps[i].size;
+		MS.heapDeviceLocal[i] = (memProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT) != 0;
+	}
+	for(auto &a : memAllocations) {
+		MS.heapUsage[a.second.heap] += a.second.size;
+	}
+
+	MS.hasBudget = false;
+	if(hasMemoryBudget) {
+		auto func = (PFN_vkGetPhysicalDeviceMemoryProperties2KHR)
+					vkGetInstanceProcAddr(instance, "vkGetPhysicalDeviceMemoryProperties2KHR");
+		if(func != nullptr) {
+			VkPhysicalDeviceMemoryBudgetPropertiesEXT budget{};
+			budget.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+			VkPhysicalDeviceMemoryProperties2KHR props{};
+			props.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2_KHR;
+			props.pNext = &budget;
+			func(physicalDevice, &props);
+			for(uint32_t i = 0; i < nHeaps; i++) {
+				MS.heapUsage[i] = budget.heapUsage[i];
+				MS.heapBudget[i] = budget.heapBudget[i];
+			}
+			MS.hasBudget = true;
+		}
+	}
+}
+
+void BaseProject::writeMemoryReport(std::string file) {
+	MemoryStats MS;
+	getMemoryStats(MS);
+
+	std::ofstream out(file);
+	if(!out.is_open()) {
+		std::cout << "Cannot write memory report: " << file << "\n";
+		return;
+	}
+	out << "{\n\t\"categories\": {\n";
+	for(int i = 0; i < MEM_CATEGORIES; i++) {
+		out << "\t\t\"" << memoryCategoryName((MemoryCategory)i) << "\": {\"used\": " << MS.used[i]
+			<< ", \"peak\": " << MS.peak[i] << ", \"allocations\": " << MS.allocations[i] << "}"
+			<< ((i < MEM_CATEGORIES - 1) ? ",\n" : "\n");
+	}
+	out << "\t},\n\t\"budgetExtension\": " << (MS.hasBudget ? "true" : "false") << ",\n\t\"heaps\": [\n";
+	for(int i = 0; i < MS.heapSize.size(); i++) {
+		out << "\t\t{\"size\": " << MS.heapSize[i] << ", \"usage\": " << MS.heapUsage[i]
+			<< ", \"budget\": " << MS.heapBudget[i] << ", \"deviceLocal\": " << (MS.heapDeviceLocal[i] ? "true" : "false") << "}"
+			<< ((i < MS.heapSize.size() - 1) ? ",\n" : "\n");
+	}
+	out << "\t]\n}\n";
+	std::cout << "Memory report written to: " << file << "\n";
+}
+
+void BaseProject::rebindTextureView(VkImageView oldView, VkImageView newView, VkSampler newSampler, int image) {
+	std::vector<VkWriteDescriptorSet> writes;
+	for(auto &b : textureBindings) {
+		if((b.info.imageView == oldView) && ((image < 0) || (b.image == image))) {
+			b.info.imageView = newView;
+			if(newSampler != VK_NULL_HANDLE) {
+				b.info.sampler = newSampler;
+			}
+			VkWriteDescriptorSet w{};
+			w.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+			w.dstSet = b.set;
+			w.dstBinding = b.binding;
+			w.dstArrayElement = b.element;
+			w.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+			w.descriptorCount = 1;
+			w.pImageInfo = &b.info;
+			writes.push_back(w);
+		}
+	}
+	if(writes.size() > 0) {
+		vkUpdateDescriptorSets(device, static_cast<uint32_t>(writes.size()), writes.data(), 0, nullptr);
+	}
+}
+
+void BaseProject::createPipelineCache() {
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(physicalDevice, &props);
+
+	std::vector<char> data;
+	PipelineCacheHeader H;
+	std::ifstream ifs(PIPELINE_CACHE_FILE, std::ios::binary | std::ios::ate);
+	uint64_t fileSize = ifs.is_open() ? (uint64_t)ifs.tellg() : 0;
+	ifs.seekg(0);
+	if(ifs.is_open() && ifs.read((char *)&H, sizeof(H))) {
+		if(H.dataSize != fileSize - sizeof(H)) {
+			// truncated or corrupted: the size cannot be trusted
+			std::cout << "[PipelineCache] " << PIPELINE_CACHE_FILE << " is damaged, discarded\n";
+		} else if((memcmp(H.magic, "FPLC", 4) == 0) &&
+		   (H.vendorID == props.vendorID) && (H.deviceID == props.deviceID) &&
+		   (H.driverVersion == props.driverVersion) &&
+		   (memcmp(H.uuid, props.pipelineCacheUUID, VK_UUID_SIZE) == 0)) {
+			data.resize(H.dataSize);
+			if(!ifs.read(data.data(), data.size())) {
+				data.clear();
+			}
+		} else {
+			std::cout << "[PipelineCache] " << PIPELINE_CACHE_FILE << " comes from another device or driver, discarded\n";
+		}
+	}
+	ifs.close();
+
+	VkPipelineCacheCreateInfo cacheInfo{};
+	cacheInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheInfo.initialDataSize = data.size();
+	cacheInfo.pInitialData = data.size() > 0 ? data.data() : nullptr;
+	VkResult result = vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache);
+	if((result != VK_SUCCESS) && (data.size() > 0)) {
+		// rejected by the driver: start from an empty cache
+		data.clear();
+		cacheInfo.initialDataSize = 0;
+		cacheInfo.pInitialData = nullptr;
+		result = vkCreatePipelineCache(device, &cacheInfo, nullptr, &pipelineCache);
+	}
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to create pipeline cache!");
+	}
+	std::cout << "[PipelineCache] " << data.size() << " bytes loaded from " << PIPELINE_CACHE_FILE << "\n";
+}
+
+void BaseProject::savePipelineCache() {
+	size_t size = 0;
+	if(vkGetPipelineCacheData(device, pipelineCache, &size, nullptr) != VK_SUCCESS) return;
+	std::vector<char> data(size);
+	if(vkGetPipelineCacheData(device, pipelineCache, &size, data.data()) != VK_SUCCESS) return;
+
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(physicalDevice, &props);
+	PipelineCacheHeader H{};
+	memcpy(H.magic, "FPLC", 4);
+	H.vendorID = props.vendorID;
+	H.deviceID = props.deviceID;
+	H.driverVersion = props.driverVersion;
+	memcpy(H.uuid, props.pipelineCacheUUID, VK_UUID_SIZE);
+	H.dataSize = size;
+
+	std::string tmp = PIPELINE_CACHE_FILE + ".tmp";
+	std::error_code ec;
+	std::filesystem::create_directories(std::filesystem::path(PIPELINE_CACHE_FILE).parent_path(), ec);
+	std::ofstream ofs(tmp, std::ios::binary);
+	if(!ofs.is_open()) {
+		std::cout << "[PipelineCache] cannot write " << tmp << "\n";
+		return;
+	}
+	ofs.write((const char *)&H, sizeof(H));
+	ofs.write(data.data(), size);
+	ofs.close();
+	std::filesystem::remove(PIPELINE_CACHE_FILE, ec);
+	std::filesystem::rename(tmp, PIPELINE_CACHE_FILE, ec);
+	std::cout << "[PipelineCache] " << size << " bytes saved to " << PIPELINE_CACHE_FILE << "\n";
+}
+
+void BaseProject::createPipelines(RenderPass *RP, std::vector<Pipeline *> PL) {
+	ProfileScope PS("createPipelines");
+	// the pipeline cache is internally synchronized: the driver can compile
+	// several pipelines at the same time
+	ThreadPool workers;
+	workers.init(std::min((int)PL.size(), std::max(1, (int)std::thread::hardware_concurrency())));
+	std::vector<std::future<void>> jobs;
+	for(auto P : PL) {
+		jobs.push_back(workers.submit([P, RP] {P->create(RP);}));
+	}
+	for(auto &j : jobs) {
+		j.get();
+	}
+	workers.cleanup();
+}
+
 void BaseProject::createDescriptorPool() {
+	uint32_t nImg = static_cast<uint32_t>(swapChainImages.size());
+	descriptorAllocator.init(this, false,
+							 std::max(1, DPSZs.setsInPool) * nImg,
+							 std::max(1, DPSZs.uniformBlocksInPool) * nImg,
+							 std::max(1, DPSZs.texturesInPool) * nImg);
+	for(int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		transientDescriptors[i].init(this);
+	}
+}
+
+VkDescriptorSet BaseProject::allocateTransientDescriptorSet(DescriptorSetLayout *DSL, const std::vector<const void *> &uniforms,
+															const std::vector<VkDescriptorImageInfo> &VaSs) {
+	return transientDescriptors[currentFrame].allocate(DSL, uniforms, VaSs);
+}
+
+void DescriptorAllocator::init(BaseProject *bp, bool isTransient, uint32_t sets, uint32_t uniforms, uint32_t textures) {
+	BP = bp;
+	transient = isTransient;
+	current = 0;
+	setsPerPool = sets;
+	uniformsPerSet = std::max(1u, uniforms / sets);
+	texturesPerSet = std::max(1u, textures / sets);
+	pools.push_back(createPool(sets, uniforms, textures));
+}
+
+DescriptorAllocator::Pool DescriptorAllocator::createPool(uint32_t sets, uint32_t uniforms, uint32_t textures) {
 	std::array<VkDescriptorPoolSize, 2> poolSizes{};
 	poolSizes[0].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	poolSizes[0].descriptorCount = static_cast<uint32_t>(DPSZs.uniformBlocksInPool * swapChainImages.size());
+	poolSizes[0].descriptorCount = uniforms;
 	poolSizes[1].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	poolSizes[1].descriptorCount = static_cast<uint32_t>(DPSZs.texturesInPool * swapChainImages.size());
+	poolSizes[1].descriptorCount = textures;
 														 
 	VkDescriptorPoolCreateInfo poolInfo{};
 	poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());;
+	// persistent sets are given back one by one, transient ones by resetting the pool
+	poolInfo.flags = transient ? 0 : VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;
+	poolInfo.poolSizeCount = static_cast<uint32_t>(poolSizes.size());
 	poolInfo.pPoolSizes = poolSizes.data();
-	poolInfo.maxSets = static_cast<uint32_t>(DPSZs.setsInPool * swapChainImages.size());
+	poolInfo.maxSets = sets;
 	
-	VkResult result = vkCreateDescriptorPool(device, &poolInfo, nullptr,
-								&descriptorPool);
+	VkDescriptorPool pool;
+	VkResult result = vkCreateDescriptorPool(BP->device, &poolInfo, nullptr, &pool);
 	if (result != VK_SUCCESS) {
 		PrintVkError(result);
 		throw std::runtime_error("failed to create descriptor pool!");
 	}
+//std::cout << "New descriptor pool: " << sets << " sets, " << uniforms << " uniforms, " << textures << " textures\n";
+	return {pool, sets, uniforms, textures, sets, uniforms, textures};
+}
+
+void DescriptorAllocator::descriptorsNeeded(DescriptorSetLayout *DSL, uint32_t count, uint32_t &uniforms, uint32_t &textures) {
+	uniforms = 0;
+	textures = 0;
+	for(auto &B : DSL->Bindings) {
+		if(B.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+			uniforms += B.count * count;
+		} else if(B.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
+			textures += B.count * count;
+		}
+	}
+}
+
+VkDescriptorPool DescriptorAllocator::allocate(DescriptorSetLayout *DSL, uint32_t count, VkDescriptorSet *sets) {
+	std::vector<VkDescriptorSetLayout> layouts(count, DSL->descriptorSetLayout);
+	VkDescriptorSetAllocateInfo allocInfo{};
+	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	allocInfo.descriptorSetCount = count;
+	allocInfo.pSetLayouts = layouts.data();
+	uint32_t needU, needT;
+	descriptorsNeeded(DSL, count, needU, needT);
+
+	// tries the current pool first, then the others (sets might have been freed)
+	for(int k = 0; k < pools.size(); k++) {
+		int p = (current + k) % pools.size();
+		Pool &P = pools[p];
+		if((P.sets < count) || (P.uniforms < needU) || (P.textures < needT)) continue;
+		allocInfo.descriptorPool = P.pool;
+		VkResult result = vkAllocateDescriptorSets(BP->device, &allocInfo, sets);
+		if(result == VK_SUCCESS) {
+			P.sets -= count;
+			P.uniforms -= needU;
+			P.textures -= needT;
+			current = p;
+			return P.pool;
+		}
+		// enough capacity left, but fragmented by the sets freed
+		if((result != VK_ERROR_OUT_OF_POOL_MEMORY) && (result != VK_ERROR_FRAGMENTED_POOL)) {
+			PrintVkError(result);
+			throw std::runtime_error("failed to allocate descriptor sets!");
+		}
+	}
+
+	// all pools are full: adds a new one, twice as large and big enough for the request
+	setsPerPool = std::min(setsPerPool * 2, 4096u);
+	uint32_t nSets = std::max(setsPerPool, count);
+	pools.push_back(createPool(nSets, std::max(nSets * uniformsPerSet, needU),
+									  std::max(nSets * texturesPerSet, needT)));
+	current = pools.size() - 1;
+	Pool &P = pools[current];
+
+	allocInfo.descriptorPool = P.pool;
+	VkResult result = vkAllocateDescriptorSets(BP->device, &allocInfo, sets);
+	if (result != VK_SUCCESS) {
+		PrintVkError(result);
+		throw std::runtime_error("failed to allocate descriptor sets!");
+	}
+	P.sets -= count;
+	P.uniforms -= needU;
+	P.textures -= needT;
+	return P.pool;
+}
+
+void DescriptorAllocator::free(DescriptorSetLayout *DSL, VkDescriptorPool pool, uint32_t count, VkDescriptorSet *sets) {
+	if(transient || (pool == VK_NULL_HANDLE) || (count == 0)) return;
+	vkFreeDescriptorSets(BP->device, pool, count, sets);
+	for(auto &P : pools) {
+		if(P.pool == pool) {
+			uint32_t needU, needT;
+			descriptorsNeeded(DSL, count, needU, needT);
+			P.sets += count;
+			P.uniforms += needU;
+			P.textures += needT;
+			break;
+		}
+	}
+}
+
+void DescriptorAllocator::reset() {
+	for(auto &P : pools) {
+		vkResetDescriptorPool(BP->device, P.pool, 0);
+		P.sets = P.maxSets;
+		P.uniforms = P.maxUniforms;
+		P.textures = P.maxTextures;
+	}
+	current = 0;
+}
+
+void DescriptorAllocator::cleanup() {
+	for(auto &P : pools) {
+		vkDestroyDescriptorPool(BP->device, P.pool, nullptr);
+	}
+	pools.clear();
+	current = 0;
+}
+
+void TransientDescriptors::init(BaseProject *bp) {
+	BP = bp;
+	sets.init(bp, true, 32, 64, 128);
+	VkPhysicalDeviceProperties props;
+	vkGetPhysicalDeviceProperties(BP->physicalDevice, &props);
+	alignment = std::max((VkDeviceSize)1, props.limits.minUniformBufferOffsetAlignment);
+	used = 0;
+}
+
+VkDescriptorBufferInfo TransientDescriptors::allocateUniform(const void *src, VkDeviceSize size) {
+	VkDeviceSize offset = (used + alignment - 1) / alignment * alignment;
+	if(blocks.empty() || (offset + size > blocks.back().size)) {
+		// the sets already written this frame still use the previous block
+		UniformBlock B;
+		B.size = blocks.empty() ? 65536 : blocks.back().size * 2;
+		while(B.size < size) {
+			B.size *= 2;
+		}
+		BP->createBuffer(B.size, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+						 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+						 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+						 B.buffer, B.memory, MEM_UNIFORM);
+		vkMapMemory(BP->device, B.memory, 0, VK_WHOLE_SIZE, 0, (void **)&B.mapped);
+		blocks.push_back(B);
+		offset = 0;
+	}
+	UniformBlock &B = blocks.back();
+	memcpy(B.mapped + offset, src, size);
+	used = offset + size;
+	return {B.buffer, offset, size};
+}
+
+// The textures are not registered for the texture streamer, since the set
+// is gone before a streamed texture can be swapped in
+VkDescriptorSet TransientDescriptors::allocate(DescriptorSetLayout *DSL, const std::vector<const void *> &uniforms,
+											   const std::vector<VkDescriptorImageInfo> &VaSs) {
+	VkDescriptorSet set;
+	sets.allocate(DSL, 1, &set);
+
+	int size = DSL->Bindings.size();
+	std::vector<VkWriteDescriptorSet> descriptorWrites(size);
+	std::vector<VkDescriptorBufferInfo> bufferInfo(size);
+	int u = 0;
+	for(int j = 0; j < size; j++) {
+		DescriptorSetLayoutBinding &B = DSL->Bindings[j];
+		descriptorWrites[j].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		descriptorWrites[j].dstSet = set;
+		descriptorWrites[j].dstBinding = B.binding;
+		descriptorWrites[j].dstArrayElement = 0;
+		descriptorWrites[j].descriptorType = B.type;
+		descriptorWrites[j].descriptorCount = B.count;
+		if(B.type == VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER) {
+			if(u >= uniforms.size()) {
+				throw std::runtime_error("missing uniform data for a transient descriptor set!");
+			}
+			bufferInfo[j] = allocateUniform(uniforms[u++], B.linkSize);
+			descriptorWrites[j].pBufferInfo = &bufferInfo[j];
+		} else if(B.type == VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER) {
+			// as in DescriptorSet::init(), linkSize is the first texture of the binding
+			descriptorWrites[j].pImageInfo = &VaSs[B.linkSize];
+		}
+	}
+	vkUpdateDescriptorSets(BP->device, static_cast<uint32_t>(descriptorWrites.size()),
+						   descriptorWrites.data(), 0, nullptr);
+	return set;
+}
+
+// called after the fence of the frame slot has been waited: nothing
+// allocated in its previous use is still read by the GPU
+void TransientDescriptors::reset() {
+	sets.reset();
+	while(blocks.size() > 1) {
+		destroyBlock(blocks.front());
+		blocks.erase(blocks.begin());
+	}
+	used = 0;
+}
+
+void TransientDescriptors::destroyBlock(UniformBlock &B) {
+	vkUnmapMemory(BP->device, B.memory);
+	vkDestroyBuffer(BP->device, B.buffer, nullptr);
+	BP->freeMemory(B.memory);
+}
+
+void TransientDescriptors::cleanup() {
+	sets.cleanup();
+	for(auto &B : blocks) {
+		destroyBlock(B);
+	}
+	blocks.clear();
+	used = 0;
 }
 
-void BaseProject::submitCommandBuffer(std::string name, int order, pNCBfunc populateNewCommandBuffer, void *params, pNCBfree onErase) {
+void BaseProject::submitCommandBuffer(std::string name, int order, pNCBfunc populateNewCommandBuffer, void *params, pNCBfree onErase,
+									  bool everyFrame) {
 	int sz = swapChainImageViews.size();
 
-	NamedCommandBuffer *nncb = new NamedCommandBuffer{name, order, {}, populateNewCommandBuffer, onErase, params, NCBS_SUBMITTED, {}};
+	NamedCommandBuffer *nncb = new NamedCommandBuffer{name, order, {}, populateNewCommandBuffer, onErase, params, NCBS_SUBMITTED, {}, everyFrame};
 	nncb->cb.resize(sz);
 	nncb->inQueue.resize(sz);
 	for(int i = 0; i < sz; i++) {
@@ -1814,6 +2708,20 @@ void BaseProject::resetCommandBuffers() {
 	}
 }
 
+void BaseProject::invalidateCommandBuffers() {
+	staleImages.assign(swapChainImages.size(), true);
+}
+
+// the command buffers of the image are recorded again the next time it is drawn
+void BaseProject::resetCommandBuffersForImage(int img) {
+	for(auto &v : namedCommandBuffers) {
+		if((v.second.current != nullptr) && v.second.current->inQueue[img]) {
+			clearNamedCommandBufferForImage(v.second.current, img);
+			v.second.current->state = NCBS_IN_CREATION;
+		}
+	}
+}
+
 void BaseProject::createSyncObjects() {
 	imageAvailableSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
 	renderFinishedSemaphores.resize(MAX_FRAMES_IN_FLIGHT);
@@ -1848,6 +2756,7 @@ void BaseProject::createSyncObjects() {
 void BaseProject::mainLoop() {
 	while (!glfwWindowShouldClose(window)){
 		glfwPollEvents();
+		textureStreamer.update();
 		drawFrame();
 	}
 	
@@ -1914,6 +2823,12 @@ void BaseProject::updateCommandBuffers(std::vector<VkCommandBuffer> &buffers, in
 	for(auto &v : namedCommandBuffers) {
 //std::cout << "Considering buffer: " << v.first << "\n";
 		NamedCommandBuffer *ncb = v.second.current;
+		if(ncb->everyFrame && ncb->inQueue[imageIndex]) {
+			// the fence of the image has been waited: its last recording is
+			// not in use, and the transient sets it used are gone
+			clearNamedCommandBufferForImage(ncb, imageIndex);
+			ncb->state = NCBS_IN_CREATION;
+		}
 		if(ncb->state == NCBS_IN_USE) {
 			sortedBuffer[ncb->order] = *ncb->cb[imageIndex];
 //			buffers.push_back(*ncb->cb[imageIndex]);
@@ -1966,6 +2881,8 @@ void BaseProject::updateCommandBuffers(std::vector<VkCommandBuffer> &buffers, in
 void BaseProject::drawFrame() {
 	vkWaitForFences(device, 1, &inFlightFences[currentFrame],
 					VK_TRUE, UINT64_MAX);
+	// the GPU is done with the previous use of this frame slot
+	transientDescriptors[currentFrame].reset();
 	
 	uint32_t imageIndex;
 	
@@ -1983,6 +2900,12 @@ void BaseProject::drawFrame() {
 		vkWaitForFences(device, 1, &imagesInFlight[imageIndex],
 						VK_TRUE, UINT64_MAX);
 	}
+	// the sets of this image are not in use: streamed textures can be swapped in
+	textureStreamer.imageAcquired(imageIndex);
+	if((imageIndex < staleImages.size()) && staleImages[imageIndex]) {
+		resetCommandBuffersForImage(imageIndex);
+		staleImages[imageIndex] = false;
+	}
 	imagesInFlight[imageIndex] = inFlightFences[currentFrame];
 	
 	updateUniformBuffer(imageIndex);
@@ -2046,33 +2969,63 @@ void BaseProject::recreateSwapChain() {
 	}
 
 	vkDeviceWaitIdle(device);
+	ProfileScope PS("recreateSwapChain");
+	size_t oldImageCount = swapChainImages.size();
 	
 	cleanupSwapChain();
 
 	createSwapChain();
 	createImageViews();
 
-	createDescriptorPool();			
-	pipelinesAndDescriptorSetsInit();
+	if((swapChainImages.size() == oldImageCount) && !rebuildPipelines) {
+		// pipelines use a dynamic viewport, and descriptor sets do not depend
+		// on the surface: only the size dependent resources are recreated
+		for(auto RP : swapChainPasses) {
+			RP->resize(swapChainExtent.width, swapChainExtent.height);
+		}
+	} else {
+		// descriptor sets and framebuffers are allocated per swap chain image
+		rebuildPipelines = false;
+		pipelinesAndDescriptorSetsCleanupAll();
+		imagesInFlight.assign(swapChainImages.size(), VK_NULL_HANDLE);
+		createDescriptorPool();			
+		pipelinesAndDescriptorSetsInit();
+	}
 
 	resetCommandBuffers();
+	staleImages.clear();
 }
 
 void BaseProject::cleanupSwapChain() {
 //		clearCommandBuffers();
 			
-	pipelinesAndDescriptorSetsCleanup();
-
 	for (size_t i = 0; i < swapChainImageViews.size(); i++){
 		vkDestroyImageView(device, swapChainImageViews[i], nullptr);
 	}
 	
 	vkDestroySwapchainKHR(device, swapChain, nullptr);
+}
 
-	vkDestroyDescriptorPool(device, descriptorPool, nullptr);
+void BaseProject::pipelinesAndDescriptorSetsCleanupAll() {
+	pipelinesAndDescriptorSetsCleanup();
+
+	descriptorAllocator.cleanup();
+	for(int i = 0; i < MAX_FRAMES_IN_FLIGHT; i++) {
+		transientDescriptors[i].cleanup();
+	}
+	textureBindings.clear();
+	swapChainPasses.clear();
 }
 	
 void BaseProject::cleanup() {
+	// report before releasing anything, so it shows what was in use
+	if(memoryReportFile != "") {
+		writeMemoryReport(memoryReportFile);
+	}
+	
+	textureStreamer.cleanup();
+
+	pipelinesAndDescriptorSetsCleanupAll();
 	cleanupSwapChain();
 		
 	localCleanup();
@@ -2084,6 +3037,9 @@ void BaseProject::cleanup() {
 	}
 	
 	vkDestroyCommandPool(device, commandPool, nullptr);
+
+	savePipelineCache();
+	vkDestroyPipelineCache(device, pipelineCache, nullptr);
 	
 	vkDestroyDevice(device, nullptr);
 	
@@ -2098,6 +3054,7 @@ void BaseProject::cleanup() {
 }
 
 void BaseProject::RebuildPipeline() {
+	rebuildPipelines = true;
 	framebufferResized = true;
 }
 
@@ -2646,6 +3603,7 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 				  if(E[i].size == sizeof(glm::vec3)) {
 					Position.hasIt = true;
 					Position.offset = E[i].offset;
+					Position.format = E[i].format;
 				  } else {
 					std::cout << "Vertex Position - wrong size\n";
 				  }
@@ -2658,6 +3616,7 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 				  if(E[i].size == sizeof(glm::vec2)) {
 					Pos2D.hasIt = true;
 					Pos2D.offset = E[i].offset;
+					Pos2D.format = E[i].format;
 				  } else {
 					std::cout << "Vertex Position 2D - wrong size\n";
 				  }
@@ -2666,10 +3625,13 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 				}
 			    break;
 			  case VertexDescriptorElementUsage::NORMAL:
-			    if(E[i].format == VK_FORMAT_R32G32B32_SFLOAT) {
-				  if(E[i].size == sizeof(glm::vec3)) {
+			    // R16G16_SNORM is an octahedral encoded normal
+			    if((E[i].format == VK_FORMAT_R32G32B32_SFLOAT) ||
+			       (E[i].format == VK_FORMAT_R16G16_SNORM)) {
+				  if(E[i].size == ((E[i].format == VK_FORMAT_R16G16_SNORM) ? sizeof(glm::i16vec2) : sizeof(glm::vec3))) {
 					Normal.hasIt = true;
 					Normal.offset = E[i].offset;
+					Normal.format = E[i].format;
 				  } else {
 					std::cout << "Vertex Normal - wrong size\n";
 				  }
@@ -2678,10 +3640,12 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 				}
 			    break;
 			  case VertexDescriptorElementUsage::UV:
-			    if(E[i].format == VK_FORMAT_R32G32_SFLOAT) {
-				  if(E[i].size == sizeof(glm::vec2)) {
+			    if((E[i].format == VK_FORMAT_R32G32_SFLOAT) ||
+			       (E[i].format == VK_FORMAT_R16G16_SFLOAT)) {
+				  if(E[i].size == ((E[i].format == VK_FORMAT_R16G16_SFLOAT) ? sizeof(glm::u16vec2) : sizeof(glm::vec2))) {
 					UV.hasIt = true;
 					UV.offset = E[i].offset;
+					UV.format = E[i].format;
 				  } else {
 					std::cout << "Vertex UV - wrong size\n";
 				  }
@@ -2694,6 +3658,7 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 				  if(E[i].size == sizeof(glm::vec3)) {
 					Color.hasIt = true;
 					Color.offset = E[i].offset;
+					Color.format = E[i].format;
 				  } else {
 					std::cout << "Vertex Color - wrong size\n";
 				  }
@@ -2702,10 +3667,14 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 				}
 			    break;
 			  case VertexDescriptorElementUsage::TANGENT:
-			    if(E[i].format == VK_FORMAT_R32G32B32A32_SFLOAT) {
-				  if(E[i].size == sizeof(glm::vec4)) {
+			    // R16G16_SNORM is an octahedral encoded tangent, with the
+			    // bitangent sign folded in the second component
+			    if((E[i].format == VK_FORMAT_R32G32B32A32_SFLOAT) ||
+			       (E[i].format == VK_FORMAT_R16G16_SNORM)) {
+				  if(E[i].size == ((E[i].format == VK_FORMAT_R16G16_SNORM) ? sizeof(glm::i16vec2) : sizeof(glm::vec4))) {
 					Tangent.hasIt = true;
 					Tangent.offset = E[i].offset;
+					Tangent.format = E[i].format;
 				  } else {
 					std::cout << "Vertex Tangent - wrong size\n";
 				  }
@@ -2714,10 +3683,12 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 				}
 			    break;
 				case VertexDescriptorElementUsage::JOINTWEIGHT:
-					if(E[i].format == VK_FORMAT_R32G32B32A32_SFLOAT) {
-						if(E[i].size == sizeof(glm::vec4)) {
+					if((E[i].format == VK_FORMAT_R32G32B32A32_SFLOAT) ||
+					   (E[i].format == VK_FORMAT_R16G16B16A16_UNORM)) {
+						if(E[i].size == ((E[i].format == VK_FORMAT_R16G16B16A16_UNORM) ? sizeof(glm::u16vec4) : sizeof(glm::vec4))) {
 							JointWeight.hasIt = true;
 							JointWeight.offset = E[i].offset;
+							JointWeight.format = E[i].format;
 						} else {
 							std::cout << "Vertex Joint Weight - wrong size\n";
 						}
@@ -2726,10 +3697,12 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 					}
 				break;
 				case VertexDescriptorElementUsage::JOINTINDEX:
-					if(E[i].format == VK_FORMAT_R32G32B32A32_UINT) {
-						if(E[i].size == sizeof(glm::uvec4)) {
+					if((E[i].format == VK_FORMAT_R32G32B32A32_UINT) ||
+					   (E[i].format == VK_FORMAT_R8G8B8A8_UINT)) {
+						if(E[i].size == ((E[i].format == VK_FORMAT_R8G8B8A8_UINT) ? sizeof(glm::u8vec4) : sizeof(glm::uvec4))) {
 							JointIndex.hasIt = true;
 							JointIndex.offset = E[i].offset;
+							JointIndex.format = E[i].format;
 						} else {
 							std::cout << "Vertex Joint Index - wrong size\n";
 						}
@@ -2749,6 +3722,95 @@ void VertexDescriptor::init(BaseProject *bp, std::vector<VertexBindingDescriptor
 void VertexDescriptor::cleanup() {
 }
 
+// Octahedral mapping of a unit vector on the [-1,1]^2 square. Degenerate
+// (zero) normals and tangents of the assets are mapped to (0,0)
+static glm::vec2 octEncode(glm::vec3 n) {
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	if(!(l1 > 0.0f)) {
+		return glm::vec2(0.0f);
+	}
+	n /= l1;
+	glm::vec2 o = glm::vec2(n.x, n.y);
+	if(n.z < 0.0f) {
+		o = (1.0f - glm::abs(glm::vec2(n.y, n.x))) *
+			glm::vec2(n.x >= 0.0f ? 1.0f : -1.0f, n.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return o;
+}
+
+void VertexDescriptor::storeNormal(unsigned char *vertex, glm::vec3 n) {
+	if(Normal.format == VK_FORMAT_R16G16_SNORM) {
+		glm::uint32 *o = (glm::uint32 *)(vertex + Normal.offset);
+		*o = glm::packSnorm2x16(octEncode(n));
+	} else {
+		glm::vec3 *o = (glm::vec3 *)(vertex + Normal.offset);
+		*o = n;
+	}
+}
+
+void VertexDescriptor::storeTangent(unsigned char *vertex, glm::vec4 t) {
+	if(Tangent.format == VK_FORMAT_R16G16_SNORM) {
+		// y is remapped to [0,1] and its sign carries the bitangent direction
+		glm::vec2 e = octEncode(glm::vec3(t));
+		e.y = glm::max(e.y * 0.5f + 0.5f, 1.0f / 32767.0f);
+		if(t.w < 0.0f) {
+			e.y = -e.y;
+		}
+		glm::uint32 *o = (glm::uint32 *)(vertex + Tangent.offset);
+		*o = glm::packSnorm2x16(e);
+	} else {
+		glm::vec4 *o = (glm::vec4 *)(vertex + Tangent.offset);
+		*o = t;
+	}
+}
+
+void VertexDescriptor::storeUV(unsigned char *vertex, glm::vec2 uv) {
+	if(UV.format == VK_FORMAT_R16G16_SFLOAT) {
+		glm::uint32 *o = (glm::uint32 *)(vertex + UV.offset);
+		*o = glm::packHalf2x16(uv);
+	} else {
+		glm::vec2 *o = (glm::vec2 *)(vertex + UV.offset);
+		*o = uv;
+	}
+}
+
+void VertexDescriptor::storeJointIndex(unsigned char *vertex, glm::uvec4 j) {
+	if(JointIndex.format == VK_FORMAT_R8G8B8A8_UINT) {
+		if(glm::any(glm::greaterThan(j, glm::uvec4(255)))) {
+			throw std::runtime_error("Joint index above 255: 8 bit joint indices support at most 256 joints");
+		}
+		glm::u8vec4 *o = (glm::u8vec4 *)(vertex + JointIndex.offset);
+		*o = glm::u8vec4(j);
+	} else {
+		glm::uvec4 *o = (glm::uvec4 *)(vertex + JointIndex.offset);
+		*o = j;
+	}
+}
+
+void VertexDescriptor::storeJointWeight(unsigned char *vertex, glm::vec4 w) {
+	if(JointWeight.format == VK_FORMAT_R16G16B16A16_UNORM) {
+		// renormalize, and give the rounding error to the largest weight
+		float sum = w.x + w.y + w.z + w.w;
+		if(sum > 0.0f) {
+			w /= sum;
+		}
+		glm::u16vec4 q = glm::u16vec4(glm::round(glm::clamp(w, 0.0f, 1.0f) * 65535.0f));
+		if(sum > 0.0f) {
+			int big = 0;
+			for(int k = 1; k < 4; k++) {
+				if(q[k] > q[big]) big = k;
+			}
+			int err = 65535 - (q.x + q.y + q.z + q.w);
+			q[big] = (glm::u16)glm::clamp((int)q[big] + err, 0, 65535);
+		}
+		glm::u16vec4 *o = (glm::u16vec4 *)(vertex + JointWeight.offset);
+		*o = q;
+	} else {
+		glm::vec4 *o = (glm::vec4 *)(vertex + JointWeight.offset);
+		*o = w;
+	}
+}
+
 std::vector<VkVertexInputBindingDescription> VertexDescriptor::getBindingDescription() {
 	std::vector<VkVertexInputBindingDescription>bindingDescription{};
 	bindingDescription.resize(Bindings.size());
@@ -2783,8 +3845,115 @@ std::vector<VkVertexInputAttributeDescription> VertexDescriptor::getAttributeDes
 
 
 
+// Loads both .gltf and .glb files: binary ones are parsed directly from a
+// memory mapped view of the file
+static bool loadGLTFFile(tinygltf::TinyGLTF &loader, tinygltf::Model &model, std::string file,
+						 std::string &warn, std::string &err) {
+	std::filesystem::path path(file);
+	std::string ext = path.extension().string();
+	if((ext == ".glb") || (ext == ".GLB")) {
+		MappedFile MF;
+		if(!MF.open(file)) {
+			err = "cannot open " + file;
+			return false;
+		}
+		return loader.LoadBinaryFromMemory(&model, &err, &warn, MF.data(),
+										   static_cast<unsigned int>(MF.size()), path.parent_path().string());
+	}
+	return loader.LoadASCIIFromFile(&model, &err, &warn, file);
+}
+
+// external files of the buffers (the .bin of a .gltf)
+static void gltfBufferFiles(const tinygltf::Model &model, std::string file, std::vector<std::string> &deps) {
+	std::filesystem::path dir = std::filesystem::path(file).parent_path();
+	for(auto &B : model.buffers) {
+		if((B.uri.size() > 0) && (B.uri.compare(0, 5, "data:") != 0)) {
+			deps.push_back((dir / B.uri).string());
+		}
+	}
+}
+
+std::mutex AssetFile::cacheMtx;
+std::unordered_map<std::string, std::shared_future<AssetFile *>> AssetFile::cache;
+bool AssetFile::verbose = false;
+
+AssetFile *AssetFile::get(std::string file, ModelType MT) {
+	std::promise<AssetFile *> loaded;
+	std::shared_future<AssetFile *> entry;
+	bool mustLoad = false;
+	{
+		std::lock_guard<std::mutex> lock(cacheMtx);
+		auto el = cache.find(file);
+		if(el != cache.end()) {
+			entry = el->second;
+		} else {
+			entry = loaded.get_future().share();
+			cache[file] = entry;
+			mustLoad = true;
+		}
+	}
+
+	if(mustLoad) {
+		ProfileScope PS("parse " + file, "asset");
+		AssetFile *AF = new AssetFile();
+		try {
+			AF->init(file, MT);
+			if(verbose) {
+				AF->printInfo();
+			}
+			loaded.set_value(AF);
+		} catch(...) {
+			delete AF;
+			loaded.set_exception(std::current_exception());
+		}
+	} else {
+		std::cout << "Asset File: " << file << " already loaded\n";
+	}
+	// if someone else is parsing the file, waits for it
+	return entry.get();
+}
+
+void AssetFile::clearCache() {
+	std::lock_guard<std::mutex> lock(cacheMtx);
+	for(auto &el : cache) {
+		try {
+			AssetFile *AF = el.second.get();
+			AF->cleanup();
+			delete AF;
+		} catch(...) {
+		}
+	}
+	cache.clear();
+}
+
+void AssetFile::printInfo() {
+	std::cout << "\n=== DEBUG INFO FROM: " << fileName << " ===\n";
+	if(type == GLTF) {
+		for (size_t m = 0; m < model.meshes.size(); ++m) {
+			const auto& mesh = model.meshes[m];
+			std::cout << "Mesh " << m << ": " << mesh.name << "\n";
+			for (size_t p = 0; p < mesh.primitives.size(); ++p) {
+				const auto& prim = mesh.primitives[p];
+				std::cout << "  Primitive " << p << ":\n";
+				for (const auto& attr : prim.attributes) {
+					std::cout << "    Attribute: " << attr.first << "\n";
+				}
+			}
+		}
+		std::cout << "Skins: " << model.skins.size() << "\n";
+		std::cout << "Animations: " << model.animations.size() << "\n";
+	} else if(type == OBJ) {
+		for (const auto& shape : shapes) {
+			std::cout << "Shape: " << shape.name << ", Indices: " << shape.mesh.indices.size() << "\n";
+		}
+		std::cout << "Materials: " << materials.size() << "\n";
+	}
+	std::cout << "===============================\n";
+}
+
 void AssetFile::init(std::string file, ModelType MT) {
 	type = MT;
+	fileName = file;
 	
 	if(type == OBJ) {
 		initOBJ(file);
@@ -2837,8 +4006,7 @@ void AssetFile::initGLTF(std::string file) {
 	std::string warn, err;
 
 	std::cout << "Loading Asset File: " << file << "[GLTF]\n";	
-	if (!loader.LoadASCIIFromFile(&model, &warn, &err, 
-					file.c_str())) {
+	if (!loadGLTFFile(loader, model, file, warn, err)) {
 		throw std::runtime_error(warn + err);
 	}
 
@@ -2902,8 +4070,7 @@ void Model::makeOBJMesh(const tinyobj::shape_t *M, const tinyobj::attrib_t *A) {
 			1 - A->texcoords[2 * index.texcoord_index + 1] 
 		};
 		if(VD->UV.hasIt) {
-			glm::vec2 *o = (glm::vec2 *)((char*)(&vertex[0]) + VD->UV.offset);
-			*o = texCoord;
+			VD->storeUV(&vertex[0], texCoord);
 		}
 
 		glm::vec3 norm = {
@@ -2912,8 +4079,7 @@ void Model::makeOBJMesh(const tinyobj::shape_t *M, const tinyobj::attrib_t *A) {
 			A->normals[3 * index.normal_index + 2]
 		};
 		if(VD->Normal.hasIt) {
-			glm::vec3 *o = (glm::vec3 *)((char*)(&vertex[0]) + VD->Normal.offset);
-			*o = norm;
+			VD->storeNormal(&vertex[0], norm);
 		}
 		
 		vertices.insert(vertices.end(), vertex.begin(), vertex.end());
@@ -3035,6 +4201,14 @@ void Model::makeGLTFMesh(tinygltf::Model *M, const tinygltf::Primitive *Prm) {
 		meshHasJointIndex = true;
 		cntJointIndex = jointAccessor.count;
 		if(cntJointIndex > cntTot) cntTot = cntJointIndex;
+		if(VD->JointIndex.hasIt && (VD->JointIndex.format == VK_FORMAT_R8G8B8A8_UINT)) {
+			for(const auto &skin : M->skins) {
+				if(skin.joints.size() > 256) {
+					throw std::runtime_error("Skin " + skin.name + " has " + std::to_string(skin.joints.size()) +
+											 " joints: 8 bit joint indices support at most 256");
+				}
+			}
+		}
 	} else {
 		if(VD->JointIndex.hasIt) {
 			std::cout << "Warning: vertex layout has Joint, but file hasn't\n";
@@ -3081,8 +4255,7 @@ void Model::makeGLTFMesh(tinygltf::Model *M, const tinygltf::Primitive *Prm) {
 				bufferNormals[3 * i + 2]
 			};
 //std::cout << "Nor: " <<	VD->Normal.offset << "\n";
-			glm::vec3 *o = (glm::vec3 *)((char*)(&vertex[0]) + VD->Normal.offset);
-			*o = normal;
+			VD->storeNormal(&vertex[0], normal);
 		}
 
 		if((i < cntTan) && meshHasTan && VD->Tangent.hasIt) {
@@ -3093,8 +4266,7 @@ void Model::makeGLTFMesh(tinygltf::Model *M, const tinygltf::Primitive *Prm) {
 				bufferTangents[4 * i + 3]
 			};
 //std::cout << "Tan: " <<	VD->Tangent.offset << "\n";
-			glm::vec4 *o = (glm::vec4 *)((char*)(&vertex[0]) + VD->Tangent.offset);
-			*o = tangent;
+			VD->storeTangent(&vertex[0], tangent);
 		}
 		
 		if((i < cntUV) && meshHasUV && VD->UV.hasIt) {
@@ -3103,8 +4275,7 @@ void Model::makeGLTFMesh(tinygltf::Model *M, const tinygltf::Primitive *Prm) {
 				bufferTexCoords[2 * i + 1] 
 			};
 //std::cout << "UV : " <<	VD->UV.offset << "\n";
-			glm::vec2 *o = (glm::vec2 *)((char*)(&vertex[0]) + VD->UV.offset);
-			*o = texCoord;
+			VD->storeUV(&vertex[0], texCoord);
 		}
 
 
@@ -3122,8 +4293,7 @@ void Model::makeGLTFMesh(tinygltf::Model *M, const tinygltf::Primitive *Prm) {
 //usedIndices[jointIndex.z] = true;
 //usedIndices[jointIndex.w] = true;
 
-			glm::uvec4 *o = (glm::uvec4 *)((char*)(&vertex[0]) + VD->JointIndex.offset);
-			*o = jointIndex;
+			VD->storeJointIndex(&vertex[0], jointIndex);
 		}
 
 		if((i < cntJointWeight) && meshHasJointWeight && VD->JointWeight.hasIt) {
@@ -3136,8 +4306,7 @@ void Model::makeGLTFMesh(tinygltf::Model *M, const tinygltf::Primitive *Prm) {
 //std::cout << bufferJointWeight[4 * i + 0] << " " << bufferJointWeight[4 * i + 1] << " " << bufferJointWeight[4 * i + 2] << " " << 
 //				bufferJointWeight[4 * i + 3] << "\n";
 
-			glm::vec4 *o = (glm::vec4 *)((char*)(&vertex[0]) + VD->JointWeight.offset);
-			*o = jointWeight;
+			VD->storeJointWeight(&vertex[0], jointWeight);
 		}
 
 //std::cout << vertices.size() << "," << vertex.size() << " Inserting\n";
@@ -3229,7 +4398,12 @@ void Model::loadModelGLTF(std::string file, bool encoded) {
 	
 	std::cout << "Loading : " << file << (encoded ? "[MGCG]" : "[GLTF]") << "\n";	
 	if(encoded) {
-		auto modelString = readFile(file);
+		// the file is decrypted in blocks on a second thread, while the blocks
+		// already available are inflated straight into the final buffer
+		MappedFile MF;
+		if(!MF.open(file)) {
+			throw std::runtime_error("failed to open file: " + file);
+		}
 		
 		const std::vector<unsigned char> key = plusaes::key_from_string(&"CG2023SkelKey128"); // 16-char = 128-bit
 		const unsigned char iv[16] = {
@@ -3237,33 +4411,48 @@ void Model::loadModelGLTF(std::string file, bool encoded) {
 			0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
 		};
 
-		// decrypt
-		unsigned long padded_size = 0;
-		std::vector<unsigned char> decrypted(modelString.size());
-
-		plusaes::decrypt_cbc((unsigned char*)modelString.data(), modelString.size(), &key[0], key.size(), &iv, &decrypted[0], decrypted.size(), &padded_size);
+		CBCDecryptStream DS;
+		DS.start(MF.data(), MF.size(), key, iv);
+		const unsigned char *first;
+		size_t firstSize = DS.next(first);
+		if(firstSize < 16) {
+			throw std::runtime_error("corrupted MGCG file: " + file);
+		}
 
+		// the first 16 bytes contain the decompressed size
+		char header[17] = {};
 		int size = 0;
-		void *decomp;
-		
-		sscanf(reinterpret_cast<char *const>(&decrypted[0]), "%d", &size);
-//std::cout << decrypted.size() << ", decomp: " << size << "\n";
-//for(int i=0;i<32;i++) {
-//	std::cout << (int)decrypted[i] << "\n";
-//}
-
-		decomp = calloc(size, 1);
-		int n = sinflate(decomp, (int)size, &decrypted[16], decrypted.size()-16);
+		memcpy(header, first, 16);
+		sscanf(header, "%d", &size);
+//std::cout << MF.size() << ", decomp: " << size << "\n";
+
+		std::vector<unsigned char> decomp(size);
+		bool started = false;
+		StreamInflater SI;
+		long long n = SI.inflate(decomp.data(), decomp.size(),
+				[&](const unsigned char *&ptr) -> size_t {
+					if(!started) {
+						started = true;
+						ptr = first + 16;
+						return firstSize - 16;
+					}
+					return DS.next(ptr);
+				});
+		DS.stop();
+		MF.close();
+		if(n < 0) {
+			throw std::runtime_error("corrupted MGCG file: " + file);
+		}
 		
 		if (!loader.LoadASCIIFromString(&model, &warn, &err, 
-						reinterpret_cast<const char *>(decomp), size, "/")) {
+						reinterpret_cast<const char *>(decomp.data()), n, "/")) {
 			throw std::runtime_error(warn + err);
 		}
 	} else {
-		if (!loader.LoadASCIIFromFile(&model, &warn, &err, 
-						file.c_str())) {
+		if (!loadGLTFFile(loader, model, file, warn, err)) {
 			throw std::runtime_error(warn + err);
 		}
+		gltfBufferFiles(model, file, bakeDeps);
 	}
 
 	for (const auto& mesh :  model.meshes) {
@@ -3287,35 +4476,432 @@ std::cout << model.nodes[0].scale.size() << "\n";
 	makeGLTFwm(&model.nodes[0]);
 }
 
+// Mesh post processing, run after every import:
+// 1) welds byte-identical vertices (OBJ files produce one vertex per index)
+// 2) reorders triangles for the post-transform vertex cache (Forsyth)
+// 3) reorders vertices in order of first use, for fetch locality
+void Model::optimizeMesh() {
+	int stride = VD->Bindings[0].stride;
+	uint32_t nv = vertices.size() / stride;
+	if((nv == 0) || (indices.size() == 0) || (indices.size() % 3 != 0)) {
+		return;
+	}
+	uint32_t origNv = nv;
+
+	// 1) Welding, with an open addressing hash table on the vertex bytes
+	{
+		uint32_t tableSize = 1;
+		while(tableSize < nv * 2) tableSize <<= 1;
+		std::vector<uint32_t> table(tableSize, UINT32_MAX);
+		std::vector<uint32_t> remap(nv);
+		std::vector<unsigned char> welded;
+		welded.reserve(vertices.size());
+		uint32_t nw = 0;
+		for(uint32_t v = 0; v < nv; v++) {
+			const unsigned char *src = &vertices[(size_t)v * stride];
+			uint64_t h = 14695981039346656037ULL;	// FNV-1a
+			for(int b = 0; b < stride; b++) {
+				h ^= src[b];
+				h *= 1099511628211ULL;
+			}
+			uint32_t slot = (uint32_t)h & (tableSize - 1);
+			while((table[slot] != UINT32_MAX) &&
+				  (memcmp(&welded[(size_t)table[slot] * stride], src, stride) != 0)) {
+				slot = (slot + 1) & (tableSize - 1);
+			}
+			if(table[slot] == UINT32_MAX) {
+				table[slot] = nw++;
+				welded.insert(welded.end(), src, src + stride);
+			}
+			remap[v] = table[slot];
+		}
+		for(auto &i : indices) {
+			i = remap[i];
+		}
+		vertices.swap(welded);
+		nv = nw;
+	}
+
+	// 2) Triangle order for the vertex cache (T. Forsyth, "Linear-Speed Vertex Cache Optimisation")
+	{
+		const int cacheSize = 32;
+		uint32_t nt = indices.size() / 3;
+		std::vector<uint32_t> triStart(nv + 1, 0);
+		std::vector<uint32_t> triList(indices.size());
+		std::vector<int> live(nv, 0);
+		std::vector<int> cachePos(nv, -1);
+		std::vector<float> vScore(nv);
+		std::vector<float> tScore(nt, 0.0f);
+		std::vector<bool> added(nt, false);
+
+		for(auto i : indices) live[i]++;
+		for(uint32_t v = 0; v < nv; v++) triStart[v + 1] = triStart[v] + live[v];
+		{
+			std::vector<uint32_t> fill(triStart.begin(), triStart.end() - 1);
+			for(uint32_t t = 0; t < nt; t++) {
+				for(int k = 0; k < 3; k++) {
+					triList[fill[indices[3 * t + k]]++] = t;
+				}
+			}
+		}
+
+		auto score = [&](uint32_t v) -> float {
+			if(live[v] == 0) return -1.0f;
+			float s = 0.0f;
+			int p = cachePos[v];
+			if(p >= 0) {
+				s = (p < 3) ? 0.75f : powf(1.0f - (float)(p - 3) / (float)(cacheSize - 3), 1.5f);
+			}
+			return s + 2.0f / sqrtf((float)live[v]);
+		};
+
+		for(uint32_t v = 0; v < nv; v++) {
+			vScore[v] = score(v);
+			for(int k = 0; k < live[v]; k++) {
+				tScore[triList[triStart[v] + k]] += vScore[v];
+			}
+		}
+
+		int best = 0;
+		for(uint32_t t = 1; t < nt; t++) {
+			if(tScore[t] > tScore[best]) best = t;
+		}
+
+		std::vector<uint32_t> out;
+		out.reserve(indices.size());
+		std::vector<uint32_t> cache, newCache;
+		uint32_t scan = 0;
+		while(out.size() < indices.size()) {
+			if(best < 0) {	// nothing useful in the cache, take the next pending triangle
+				while(added[scan]) scan++;
+				best = scan;
+			}
+			added[best] = true;
+			newCache.clear();
+			for(int k = 0; k < 3; k++) {
+				uint32_t v = indices[3 * best + k];
+				out.push_back(v);
+				newCache.push_back(v);
+				uint32_t *b = &triList[triStart[v]];
+				uint32_t *e = b + live[v];
+				uint32_t *f = std::find(b, e, (uint32_t)best);
+				*f = *(e - 1);
+				live[v]--;
+			}
+			for(auto v : cache) {
+				if((v != newCache[0]) && (v != newCache[1]) && (v != newCache[2])) {
+					newCache.push_back(v);
+				}
+			}
+			for(size_t i = cacheSize; i < newCache.size(); i++) {
+				uint32_t v = newCache[i];
+				cachePos[v] = -1;
+				float ns = score(v);
+				for(int k = 0; k < live[v]; k++) {
+					tScore[triList[triStart[v] + k]] += ns - vScore[v];
+				}
+				vScore[v] = ns;
+			}
+			if(newCache.size() > cacheSize) newCache.resize(cacheSize);
+			cache.swap(newCache);
+
+			for(size_t i = 0; i < cache.size(); i++) {
+				uint32_t v = cache[i];
+				cachePos[v] = i;
+				float ns = score(v);
+				for(int k = 0; k < live[v]; k++) {
+					tScore[triList[triStart[v] + k]] += ns - vScore[v];
+				}
+				vScore[v] = ns;
+			}
+			best = -1;
+			float bestScore = -1.0f;
+			for(auto v : cache) {
+				for(int k = 0; k < live[v]; k++) {
+					uint32_t t = triList[triStart[v] + k];
+					if(tScore[t] > bestScore) {
+						bestScore = tScore[t];
+						best = t;
+					}
+				}
+			}
+		}
+		indices.swap(out);
+	}
+
+	// 3) Vertex order of first use
+	{
+		std::vector<uint32_t> remap(nv, UINT32_MAX);
+		std::vector<unsigned char> ordered;
+		ordered.reserve(vertices.size());
+		uint32_t nextId = 0;
+		for(auto &i : indices) {
+			if(remap[i] == UINT32_MAX) {
+				remap[i] = nextId++;
+				ordered.insert(ordered.end(), vertices.begin() + (size_t)i * stride,
+											  vertices.begin() + (size_t)(i + 1) * stride);
+			}
+			i = remap[i];
+		}
+		vertices.swap(ordered);
+		nv = nextId;
+	}
+
+	std::cout << "[Optimized] Vertices: " << origNv << " -> " << nv
+			  << " Indices: " << indices.size() << ((nv <= 0xFFFF) ? " (16 bit)\n" : " (32 bit)\n");
+}
+
 void Model::createVertexBuffer() {
 //	VkDeviceSize bufferSize = sizeof(vertices[0]) * vertices.size();
 	VkDeviceSize bufferSize = vertices.size();
+	const unsigned char *src = vertices.data();
+	if(baked != nullptr) {
+		bufferSize = (VkDeviceSize)bakedHeader.stride * bakedHeader.vertexCount;
+		src = baked->data() + sizeof(FMeshHeader);
+	}
 
 	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, 
 						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-						vertexBuffer, vertexBufferMemory);
+						vertexBuffer, vertexBufferMemory, memCategory);
 
 	void* data;
 	vkMapMemory(BP->device, vertexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, vertices.data(), (size_t) bufferSize);
+	memcpy(data, src, (size_t) bufferSize);
 	vkUnmapMemory(BP->device, vertexBufferMemory);			
 }
 
 void Model::createIndexBuffer() {
-	VkDeviceSize bufferSize = sizeof(indices[0]) * indices.size();
+	// indices are always kept as 32 bits on the CPU side, but small meshes
+	// are uploaded with 16 bits indices
+	size_t vertexCount = (baked != nullptr) ? bakedHeader.vertexCount : vertices.size() / VD->Bindings[0].stride;
+	indexType = (vertexCount <= 0xFFFF) ? VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+	VkDeviceSize bufferSize = ((indexType == VK_INDEX_TYPE_UINT16) ? sizeof(uint16_t) : sizeof(uint32_t)) *
+							  indices.size();
 
 	BP->createBuffer(bufferSize, VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
 							 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 							 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-							 indexBuffer, indexBufferMemory);
+							 indexBuffer, indexBufferMemory, memCategory);
 
 	void* data;
 	vkMapMemory(BP->device, indexBufferMemory, 0, bufferSize, 0, &data);
-	memcpy(data, indices.data(), (size_t) bufferSize);
+	if(baked != nullptr) {
+		// the baked indices are already in the GPU format
+		memcpy(data, baked->data() + sizeof(FMeshHeader) +
+					 (size_t)bakedHeader.stride * bakedHeader.vertexCount, (size_t) bufferSize);
+	} else if(indexType == VK_INDEX_TYPE_UINT16) {
+		uint16_t *o = (uint16_t *)data;
+		for(size_t i = 0; i < indices.size(); i++) {
+			o[i] = (uint16_t)indices[i];
+		}
+	} else {
+		memcpy(data, indices.data(), (size_t) bufferSize);
+	}
 	vkUnmapMemory(BP->device, indexBufferMemory);
 }
 
+bool MappedFile::open(std::string file) {
+	close();
+#ifndef _WIN32
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if(fd < 0) return false;
+	struct stat st;
+	if((fstat(fd, &st) != 0) || (st.st_size == 0)) {
+		::close(fd);
+		return false;
+	}
+	void *p = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	::close(fd);
+	if(p == MAP_FAILED) return false;
+	ptr = (const unsigned char *)p;
+	len = st.st_size;
+#else
+	std::ifstream ifs(file, std::ios::binary | std::ios::ate);
+	if(!ifs.is_open()) return false;
+	buffer.resize(ifs.tellg());
+	ifs.seekg(0);
+	ifs.read((char *)buffer.data(), buffer.size());
+	ptr = buffer.data();
+	len = buffer.size();
+#endif
+	return true;
+}
+
+void MappedFile::close() {
+#ifndef _WIN32
+	if(ptr != nullptr) {
+		munmap((void *)ptr, len);
+	}
+#endif
+	std::vector<unsigned char>().swap(buffer);
+	ptr = nullptr;
+	len = 0;
+}
+
+// FNV-1a of everything that changes the baked vertex bytes
+uint64_t Model::layoutHash(VertexDescriptor *VD) {
+	uint64_t h = 1469598103934665603ull;
+	auto mix = [&h](uint64_t v) {
+		for(int i = 0; i < 8; i++) {
+			h ^= (v >> (i * 8)) & 0xff;
+			h *= 1099511628211ull;
+		}
+	};
+	mix(FMESH_VERSION);
+	for(auto &B : VD->Bindings) {
+		mix(B.binding); mix(B.stride);
+	}
+	for(auto &E : VD->Layout) {
+		mix(E.binding); mix(E.location); mix(E.format); mix(E.offset); mix(E.usage);
+	}
+	return h;
+}
+
+std::string Model::bakedFileName(std::string key, uint64_t layout) {
+	uint64_t h = 1469598103934665603ull;
+	for(char c : key) {
+		h ^= (unsigned char)c;
+		h *= 1099511628211ull;
+	}
+	char name[40];
+	snprintf(name, sizeof(name), "%016llx_%016llx.fmesh", (unsigned long long)h, (unsigned long long)layout);
+	return FMESH_DIR + name;
+}
+
+// temporary name to write a cache file, unique for each thread, so that
+// concurrent loads of the same asset never write the same file
+static std::string tempFileName(std::string name) {
+	return name + "." + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id())) + ".tmp";
+}
+
+static bool getSourceStamp(std::string source, uint64_t &size, int64_t &time) {
+	std::error_code ec;
+	size = std::filesystem::file_size(source, ec);
+	if(ec) return false;
+	auto t = std::filesystem::last_write_time(source, ec);
+	if(ec) return false;
+	time = (int64_t)t.time_since_epoch().count();
+	return true;
+}
+
+// checks the table of the other files read by the import
+static bool bakedDepsCurrent(const unsigned char *table, uint32_t count, uint32_t bytes) {
+	const unsigned char *end = table + bytes;
+	for(uint32_t i = 0; i < count; i++) {
+		uint64_t bakedSize, size;
+		int64_t bakedTime, time;
+		if(end - table < (ptrdiff_t)(sizeof(bakedSize) + sizeof(bakedTime) + 1)) return false;
+		memcpy(&bakedSize, table, sizeof(bakedSize));
+		memcpy(&bakedTime, table + sizeof(bakedSize), sizeof(bakedTime));
+		table += sizeof(bakedSize) + sizeof(bakedTime);
+		const unsigned char *name = table;
+		while((table < end) && (*table != 0)) table++;
+		if(table == end) return false;
+		table++;
+		if(!getSourceStamp(std::string((const char *)name), size, time) ||
+		   (size != bakedSize) || (time != bakedTime)) return false;
+	}
+	return table == end;
+}
+
+bool Model::loadBaked(std::string source, std::string key) {
+	uint64_t layout = layoutHash(VD);
+	uint64_t size;
+	int64_t time;
+	if(!getSourceStamp(source, size, time)) return false;
+
+	MappedFile *MF = new MappedFile();
+	if(!MF->open(bakedFileName(key, layout)) || (MF->size() < sizeof(FMeshHeader))) {
+		delete MF;
+		return false;
+	}
+	FMeshHeader H;
+	memcpy(&H, MF->data(), sizeof(FMeshHeader));
+	if((memcmp(H.magic, "FMSH", 4) != 0) || (H.version != FMESH_VERSION) ||
+	   (H.layoutHash != layout) || (H.stride != VD->Bindings[0].stride) ||
+	   (H.sourceSize != size) || (H.sourceTime != time) ||
+	   (MF->size() != sizeof(FMeshHeader) + (size_t)H.stride * H.vertexCount + (size_t)H.indexSize * H.indexCount + H.depBytes) ||
+	   !bakedDepsCurrent(MF->data() + MF->size() - H.depBytes, H.depCount, H.depBytes)) {
+		std::cout << "[Baked] " << key << " is stale, baking it again\n";
+		delete MF;
+		return false;
+	}
+
+	baked = MF;
+	bakedHeader = H;
+	Wm = glm::make_mat4(H.Wm);
+	bounds = glm::vec4(H.bounds[0], H.bounds[1], H.bounds[2], H.bounds[3]);
+	hasBounds = true;
+
+	// the draw calls need the indices count
+	const unsigned char *idx = MF->data() + sizeof(FMeshHeader) + (size_t)H.stride * H.vertexCount;
+	indices.resize(H.indexCount);
+	if(H.indexSize == 2) {
+		const uint16_t *i16 = (const uint16_t *)idx;
+		for(uint32_t i = 0; i < H.indexCount; i++) {
+			indices[i] = i16[i];
+		}
+	} else {
+		memcpy(indices.data(), idx, (size_t)H.indexCount * sizeof(uint32_t));
+	}
+	std::cout << "[Baked] " << key << " -> Vertices: " << H.vertexCount << " Indices: " << H.indexCount << "\n";
+	return true;
+}
+
+void Model::saveBaked(std::string source, std::string key) {
+	FMeshHeader H{};
+	memcpy(H.magic, "FMSH", 4);
+	H.version = FMESH_VERSION;
+	H.layoutHash = layoutHash(VD);
+	if(!getSourceStamp(source, H.sourceSize, H.sourceTime)) return;
+	H.stride = VD->Bindings[0].stride;
+	H.vertexCount = vertices.size() / H.stride;
+	H.indexCount = indices.size();
+	H.indexSize = (H.vertexCount <= 0xFFFF) ? 2 : 4;
+	std::vector<unsigned char> deps;
+	for(auto &D : bakeDeps) {
+		uint64_t size;
+		int64_t time;
+		// a file that cannot be found now would make the bake always stale
+		if(!getSourceStamp(D, size, time)) continue;
+		const unsigned char *s = (const unsigned char *)&size, *t = (const unsigned char *)&time;
+		deps.insert(deps.end(), s, s + sizeof(size));
+		deps.insert(deps.end(), t, t + sizeof(time));
+		deps.insert(deps.end(), D.c_str(), D.c_str() + D.size() + 1);
+		H.depCount++;
+	}
+	H.depBytes = deps.size();
+	glm::vec4 bs = getBoundingSphere();
+	for(int i = 0; i < 4; i++) {
+		H.bounds[i] = bs[i];
+	}
+	memcpy(H.Wm, &Wm[0][0], sizeof(H.Wm));
+
+	std::string name = bakedFileName(key, H.layoutHash);
+	std::string tmp = tempFileName(name);
+	std::error_code ec;
+	std::filesystem::create_directories(FMESH_DIR, ec);
+	std::ofstream ofs(tmp, std::ios::binary);
+	if(!ofs.is_open()) {
+		std::cout << "[Baked] cannot write " << tmp << "\n";
+		return;
+	}
+	ofs.write((const char *)&H, sizeof(H));
+	ofs.write((const char *)vertices.data(), vertices.size());
+	if(H.indexSize == 2) {
+		std::vector<uint16_t> i16(indices.begin(), indices.end());
+		ofs.write((const char *)i16.data(), i16.size() * sizeof(uint16_t));
+	} else {
+		ofs.write((const char *)indices.data(), indices.size() * sizeof(uint32_t));
+	}
+	ofs.write((const char *)deps.data(), deps.size());
+	ofs.close();
+	// replaced only when complete, so a crash never leaves a truncated bake
+	std::filesystem::remove(name, ec);
+	std::filesystem::rename(tmp, name, ec);
+}
+
 void Model::initMesh(BaseProject *bp, VertexDescriptor *vd, bool printDebug) {
 	BP = bp;
 	VD = vd;
@@ -3330,10 +4916,24 @@ void Model::initMesh(BaseProject *bp, VertexDescriptor *vd, bool printDebug) {
 }
 
 void Model::init(BaseProject *bp, VertexDescriptor *vd, std::string file, ModelType MT) {
+	load(bp, vd, file, MT);
+	upload();
+}
+
+void Model::initFromAsset(BaseProject *bp, VertexDescriptor *vd, AssetFile *AF, std::string AN, int Mid, std::string NN) {
+	loadFromAsset(bp, vd, AF, AN, Mid, NN);
+	upload();
+}
+
+void Model::load(BaseProject *bp, VertexDescriptor *vd, std::string file, ModelType MT) {
 	BP = bp;
 	VD = vd;
 	Wm = glm::mat4(1);
 
+	if(loadBaked(file, file)) {
+		return;
+	}
+
 	if(MT == OBJ) {
 		loadModelOBJ(file);
 	} else if(MT == GLTF) {
@@ -3342,15 +4942,51 @@ void Model::init(BaseProject *bp, VertexDescriptor *vd, std::string file, ModelT
 		loadModelGLTF(file, true);
 	}
 	
+	optimizeMesh();
+	saveBaked(file, file);
+}
+
+void Model::upload() {
 	createVertexBuffer();
 	createIndexBuffer();
+	if(baked != nullptr) {
+		delete baked;
+		baked = nullptr;
+	}
 }
 
-void Model::initFromAsset(BaseProject *bp, VertexDescriptor *vd, AssetFile *AF, std::string AN, int Mid, std::string NN) {
+void Model::initFromAsset(BaseProject *bp, VertexDescriptor *vd, std::string assetFile, ModelType AT, std::string AN, int Mid, std::string NN) {
+	loadFromAsset(bp, vd, assetFile, AT, AN, Mid, NN);
+	upload();
+}
+
+void Model::loadFromAsset(BaseProject *bp, VertexDescriptor *vd, std::string assetFile, ModelType AT, std::string AN, int Mid, std::string NN) {
 	BP = bp;
 	VD = vd;
 	Wm = glm::mat4(1);
 
+	std::string key = assetFile + "|" + AN + "|" + std::to_string(Mid) + "|" + NN;
+	if(loadBaked(assetFile, key)) {
+		return;
+	}
+	extractFromAsset(AssetFile::get(assetFile, AT), AN, Mid, NN);
+	saveBaked(assetFile, key);
+}
+
+void Model::loadFromAsset(BaseProject *bp, VertexDescriptor *vd, AssetFile *AF, std::string AN, int Mid, std::string NN) {
+	BP = bp;
+	VD = vd;
+	Wm = glm::mat4(1);
+
+	std::string key = AF->fileName + "|" + AN + "|" + std::to_string(Mid) + "|" + NN;
+	if(loadBaked(AF->fileName, key)) {
+		return;
+	}
+	extractFromAsset(AF, AN, Mid, NN);
+	saveBaked(AF->fileName, key);
+}
+
+void Model::extractFromAsset(AssetFile *AF, std::string AN, int Mid, std::string NN) {
 	switch(AF->type) {
 	  case GLTF:
    	    {
@@ -3360,6 +4996,7 @@ void Model::initFromAsset(BaseProject *bp, VertexDescriptor *vd, AssetFile *AF,
    		  	std::vector<const tinygltf::Primitive *> P = el->second;
    		  	if((Mid >= 0) && (Mid < P.size())) {
    		  		makeGLTFMesh(&AF->model, P[Mid]);
+   		  		gltfBufferFiles(AF->model, AF->fileName, bakeDeps);
    		  	} else {
    		  		std::cout << "Asset >" << AN << "< does not have component: " << Mid << "\n";
    		  	}
@@ -3397,15 +5034,33 @@ void Model::initFromAsset(BaseProject *bp, VertexDescriptor *vd, AssetFile *AF,
 	    break;
 	}
 
-	createVertexBuffer();
-	createIndexBuffer();
+	optimizeMesh();
 }
 
 void Model::cleanup() {
    	vkDestroyBuffer(BP->device, indexBuffer, nullptr);
-   	vkFreeMemory(BP->device, indexBufferMemory, nullptr);
+   	BP->freeMemory(indexBufferMemory);
 	vkDestroyBuffer(BP->device, vertexBuffer, nullptr);
-   	vkFreeMemory(BP->device, vertexBufferMemory, nullptr);
+   	BP->freeMemory(vertexBufferMemory);
+}
+
+glm::vec4 Model::getBoundingSphere() {
+	if(!hasBounds) {
+		glm::vec3 mn(0.0f), mx(0.0f);
+		int stride = VD->Bindings[0].stride;
+		size_t nv = vertices.size() / stride;
+		if(VD->Position.hasIt && (nv > 0)) {
+			mn = mx = *(glm::vec3 *)(&vertices[VD->Position.offset]);
+			for(size_t i = 1; i < nv; i++) {
+				glm::vec3 p = *(glm::vec3 *)(&vertices[i * stride + VD->Position.offset]);
+				mn = glm::min(mn, p);
+				mx = glm::max(mx, p);
+			}
+		}
+		bounds = glm::vec4((mn + mx) * 0.5f, glm::length(mx - mn) * 0.5f);
+		hasBounds = true;
+	}
+	return bounds;
 }
 
 void Model::bind(VkCommandBuffer commandBuffer) {
@@ -3415,7 +5070,7 @@ void Model::bind(VkCommandBuffer commandBuffer) {
 	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
 	// property .indexBuffer of models, contains the VkBuffer handle to its index buffer
 	vkCmdBindIndexBuffer(commandBuffer, indexBuffer, 0,
-							VK_INDEX_TYPE_UINT32);
+							indexType);
 }
 
 
@@ -3462,7 +5117,7 @@ void Texture::createTextureImage(std::vector<std::string>files, VkFormat Fmt) {
 	BP->createBuffer(totalImageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
 	  						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 	  						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-	  						stagingBuffer, stagingBufferMemory);
+	  						stagingBuffer, stagingBufferMemory, MEM_STAGING);
 	void* data;
 	vkMapMemory(BP->device, stagingBufferMemory, 0, totalImageSize, 0, &data);
 	for(int i = 0; i < imgs; i++) {
@@ -3477,7 +5132,7 @@ void Texture::createTextureImage(std::vector<std::string>files, VkFormat Fmt) {
 				VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT,
 				imgs == 6 ? VK_IMAGE_CREATE_CUBE_COMPATIBLE_BIT : 0,
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage,
-				textureImageMemory);
+				textureImageMemory, MEM_TEXTURE);
 				
 	BP->transitionImageLayout(textureImage, Fmt,
 			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, imgs);
@@ -3488,7 +5143,7 @@ void Texture::createTextureImage(std::vector<std::string>files, VkFormat Fmt) {
 					texWidth, texHeight, mipLevels, imgs);
 
 	vkDestroyBuffer(BP->device, stagingBuffer, nullptr);
-	vkFreeMemory(BP->device, stagingBufferMemory, nullptr);
+	BP->freeMemory(stagingBufferMemory);
 }
 
 void Texture::createTextureImageView(VkFormat Fmt) {
@@ -3546,6 +5201,221 @@ void Texture::init(BaseProject *bp, std::string file, VkFormat Fmt, bool initSam
 	}
 }
 
+// Box filters an RGBA image down by 2^levels, following the size rule of the
+// GPU mip chain
+static std::vector<unsigned char> downsampleRGBA(const unsigned char *src, int w, int h, uint32_t levels, int &ow, int &oh) {
+	std::vector<unsigned char> cur;
+	const unsigned char *in = src;
+	for(uint32_t l = 0; (l < levels) && ((w > 1) || (h > 1)); l++) {
+		int nw = std::max(1, w / 2), nh = std::max(1, h / 2);
+		std::vector<unsigned char> nxt((size_t)nw * nh * 4);
+		for(int y = 0; y < nh; y++) {
+			int y0 = std::min(2 * y, h - 1), y1 = std::min(2 * y + 1, h - 1);
+			for(int x = 0; x < nw; x++) {
+				int x0 = std::min(2 * x, w - 1), x1 = std::min(2 * x + 1, w - 1);
+				for(int c = 0; c < 4; c++) {
+					int sum = in[((size_t)y0 * w + x0) * 4 + c] + in[((size_t)y0 * w + x1) * 4 + c] +
+							  in[((size_t)y1 * w + x0) * 4 + c] + in[((size_t)y1 * w + x1) * 4 + c];
+					nxt[((size_t)y * nw + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+				}
+			}
+		}
+		cur.swap(nxt);
+		in = cur.data();
+		w = nw;
+		h = nh;
+	}
+	if(in == src) {
+		cur.assign(src, src + (size_t)w * h * 4);
+	}
+	ow = w;
+	oh = h;
+	return cur;
+}
+
+static std::string mipCacheName(std::string source) {
+	uint64_t h = 1469598103934665603ull;
+	for(char c : source) {
+		h ^= (unsigned char)c;
+		h *= 1099511628211ull;
+	}
+	char name[24];
+	snprintf(name, sizeof(name), "%016llx.fmip", (unsigned long long)h);
+	return FMIP_DIR + name;
+}
+
+void Texture::setStreamSize(int w, int h, int tailSize) {
+	fullWidth = w;
+	fullHeight = h;
+	fullMipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(fullWidth, fullHeight)))) + 1;
+	tailMip = 0;
+	while((tailMip + 1 < fullMipLevels) && (std::max(fullWidth >> tailMip, fullHeight >> tailMip) > tailSize)) {
+		tailMip++;
+	}
+}
+
+// reads a single level of the mip cache (thread safe, used by the streamer)
+bool Texture::readMip(uint32_t mip, std::vector<unsigned char> &pixels, int &w, int &h) {
+	std::ifstream ifs(mipFile, std::ios::binary);
+	FMipHeader H;
+	if(!ifs.is_open() || !ifs.read((char *)&H, sizeof(H)) || (mip >= H.levels)) return false;
+	size_t offset = sizeof(H);
+	for(uint32_t l = 0; l < mip; l++) {
+		offset += (size_t)std::max(1u, H.width >> l) * std::max(1u, H.height >> l) * 4;
+	}
+	w = std::max(1u, H.width >> mip);
+	h = std::max(1u, H.height >> mip);
+	pixels.resize((size_t)w * h * 4);
+	ifs.seekg(offset);
+	return (bool)ifs.read((char *)pixels.data(), pixels.size());
+}
+
+// the tail of an up to date mip cache, without decoding the source
+bool Texture::loadMipCache(int tailSize) {
+	uint64_t size;
+	int64_t time;
+	if(!getSourceStamp(streamFile, size, time)) return false;
+	std::ifstream ifs(mipFile, std::ios::binary);
+	FMipHeader H;
+	if(!ifs.is_open() || !ifs.read((char *)&H, sizeof(H))) return false;
+	ifs.close();
+	if((memcmp(H.magic, "FMIP", 4) != 0) || (H.version != FMIP_VERSION) ||
+	   (H.sourceSize != size) || (H.sourceTime != time)) {
+		std::cout << "[Streaming] " << streamFile << " mips are stale, computing them again\n";
+		return false;
+	}
+	setStreamSize(H.width, H.height, tailSize);
+	if((H.levels <= tailMip) || !readMip(tailMip, decodedPixels, decodedWidth, decodedHeight)) return false;
+	decodedChannels = 4;
+	return true;
+}
+
+// writes the levels from the top to the tail while computing them, and keeps
+// the tail in decodedPixels
+void Texture::bakeMips(const unsigned char *pixels) {
+	FMipHeader H{};
+	memcpy(H.magic, "FMIP", 4);
+	H.version = FMIP_VERSION;
+	H.width = fullWidth;
+	H.height = fullHeight;
+	H.levels = tailMip + 1;
+	std::string tmp = tempFileName(mipFile);
+	std::ofstream ofs;
+	if(getSourceStamp(streamFile, H.sourceSize, H.sourceTime)) {
+		std::error_code ec;
+		std::filesystem::create_directories(FMIP_DIR, ec);
+		ofs.open(tmp, std::ios::binary);
+		ofs.write((const char *)&H, sizeof(H));
+	}
+
+	std::vector<unsigned char> cur;
+	const unsigned char *in = pixels;
+	int w = fullWidth, h = fullHeight;
+	for(uint32_t l = 0; ; l++) {
+		if(ofs.is_open()) {
+			ofs.write((const char *)in, (size_t)w * h * 4);
+		}
+		if(l == tailMip) break;
+		cur = downsampleRGBA(in, w, h, 1, w, h);
+		in = cur.data();
+	}
+	if(in == pixels) {
+		cur.assign(pixels, pixels + (size_t)w * h * 4);
+	}
+	decodedPixels.swap(cur);
+	decodedWidth = w;
+	decodedHeight = h;
+
+	bool ok = ofs.is_open() && ofs.good();
+	ofs.close();
+	std::error_code ec;
+	if(ok) {
+		std::filesystem::remove(mipFile, ec);
+		std::filesystem::rename(tmp, mipFile, ec);
+		ok = !ec;
+	} else {
+		std::filesystem::remove(tmp, ec);
+	}
+	if(!ok) {
+		std::cout << "[Streaming] cannot write " << mipFile << ", " << streamFile << " will be decoded at every request\n";
+		mipFile = "";
+	}
+}
+
+void Texture::decode(std::string file, bool stream, int tailSize) {
+	decodedFile = file;
+	streaming = stream;
+	if(stream) {
+		streamFile = file;
+		mipFile = mipCacheName(file);
+		if(loadMipCache(tailSize)) return;
+	}
+
+	int texWidth, texHeight;
+	stbi_uc* pixels = stbi_load(file.c_str(), &texWidth, &texHeight,
+								&decodedChannels, STBI_rgb_alpha);
+	if (!pixels) {
+		std::cout << "Not found: " << file << "\n";
+		throw std::runtime_error("failed to load texture image!");
+	}
+	if(stream) {
+		setStreamSize(texWidth, texHeight, tailSize);
+		bakeMips(pixels);
+	} else {
+		decodedPixels = downsampleRGBA(pixels, texWidth, texHeight, 0, decodedWidth, decodedHeight);
+	}
+	stbi_image_free(pixels);
+}
+
+void Texture::upload(BaseProject *bp, VkFormat Fmt) {
+	BP = bp;
+	imgs = 1;
+	if(streaming) {
+		streamFmt = Fmt;
+		std::cout << "[Streaming]" << decodedFile << " -> size: " << fullWidth << "x" << fullHeight
+				  << ", resident tail: " << decodedWidth << "x" << decodedHeight << "\n";
+	} else {
+		std::cout << "[0]" << decodedFile << " -> size: " << decodedWidth
+				  << "x" << decodedHeight << ", ch: " << decodedChannels <<"\n";
+	}
+
+	VkImage oldImage = textureImage;
+	VkDeviceMemory oldMemory = textureImageMemory;
+	VkImageView oldView = textureImageView;
+	VkSampler oldSampler = textureSampler;
+
+	createTextureImageFromPixels(decodedPixels.data(), decodedWidth, decodedHeight, Fmt);
+	createTextureImageView(Fmt);
+	if(streaming) {
+		createTextureSampler(VK_FILTER_LINEAR, VK_FILTER_LINEAR, VK_SAMPLER_ADDRESS_MODE_REPEAT,
+							 VK_SAMPLER_ADDRESS_MODE_REPEAT, VK_SAMPLER_MIPMAP_MODE_LINEAR,
+							 VK_TRUE, 16, static_cast<float>(fullMipLevels));
+		residentMip = wantedMip = tailMip;
+		BP->textureStreamer.add(BP, this);
+	} else {
+		createTextureSampler();
+	}
+	std::vector<unsigned char>().swap(decodedPixels);
+
+	if(placeholder) {
+		// the sets of each swap chain image are updated when it is acquired,
+		// the placeholder is released once no frame in flight can use it
+		BP->textureStreamer.retire(this, oldImage, oldMemory, oldView, oldSampler);
+		placeholder = false;
+	}
+}
+
+void Texture::initPlaceholder(BaseProject *bp, VkFormat Fmt) {
+	const unsigned char grey[4] = {128, 128, 128, 255};
+
+	BP = bp;
+	imgs = 1;
+	createTextureImageFromPixels(grey, 1, 1, Fmt);
+	createTextureImageView(Fmt);
+	createTextureSampler();
+	placeholder = true;
+}
+
 
 void Texture::initCubic(BaseProject *bp, std::vector<std::string>files, VkFormat Fmt) {
 	if(files.size() != 6) {
@@ -3567,10 +5437,401 @@ void Texture::cleanup() {
    	vkDestroySampler(BP->device, textureSampler, nullptr);
    	vkDestroyImageView(BP->device, textureImageView, nullptr);
 	vkDestroyImage(BP->device, textureImage, nullptr);
-	vkFreeMemory(BP->device, textureImageMemory, nullptr);
+	BP->freeMemory(textureImageMemory);
 }
 
 
+void Texture::createTextureImageFromPixels(const unsigned char *pixels, int w, int h, VkFormat Fmt) {
+	VkDeviceSize imageSize = (VkDeviceSize)w * h * 4;
+	mipLevels = static_cast<uint32_t>(std::floor(std::log2(std::max(w, h)))) + 1;
+
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	BP->createBuffer(imageSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+	  						VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+	  						VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	  						stagingBuffer, stagingBufferMemory, MEM_STAGING);
+	void* data;
+	vkMapMemory(BP->device, stagingBufferMemory, 0, imageSize, 0, &data);
+	memcpy(data, pixels, static_cast<size_t>(imageSize));
+	vkUnmapMemory(BP->device, stagingBufferMemory);
+
+	BP->createImage(w, h, mipLevels, 1, VK_SAMPLE_COUNT_1_BIT, Fmt,
+				VK_IMAGE_TILING_OPTIMAL, VK_IMAGE_USAGE_TRANSFER_SRC_BIT |
+				VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, 0,
+				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, textureImage,
+				textureImageMemory, MEM_TEXTURE);
+	BP->transitionImageLayout(textureImage, Fmt,
+			VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, mipLevels, 1);
+	BP->copyBufferToImage(stagingBuffer, textureImage,
+			static_cast<uint32_t>(w), static_cast<uint32_t>(h), 1);
+	BP->generateMipmaps(textureImage, Fmt, w, h, mipLevels, 1);
+
+	vkDestroyBuffer(BP->device, stagingBuffer, nullptr);
+	BP->freeMemory(stagingBufferMemory);
+}
+
+VkDeviceSize Texture::mipChainBytes(uint32_t firstMip) {
+	VkDeviceSize tot = 0;
+	for(uint32_t l = firstMip; l < fullMipLevels; l++) {
+		tot += (VkDeviceSize)std::max(1, fullWidth >> l) * std::max(1, fullHeight >> l) * 4;
+	}
+	return tot;
+}
+
+void Texture::initStreaming(BaseProject *bp, std::string file, VkFormat Fmt, int tailSize) {
+	decode(file, true, tailSize);
+	upload(bp, Fmt);
+}
+
+
+std::mutex Profiler::mtx;
+std::vector<Profiler::Event> Profiler::events;
+std::unordered_map<std::thread::id, int> Profiler::tids;
+std::chrono::high_resolution_clock::time_point Profiler::origin = std::chrono::high_resolution_clock::now();
+std::atomic<bool> Profiler::enabled(false);
+std::atomic<int> Profiler::holds(1);		// the startup
+std::string Profiler::traceFile;
+
+void Profiler::enable(std::string file) {
+	enabled = true;
+	traceFile = file;
+}
+
+long long Profiler::now() {
+	return std::chrono::duration_cast<std::chrono::microseconds>(
+				std::chrono::high_resolution_clock::now() - origin).count();
+}
+
+void Profiler::record(const std::string &name, const char *cat, long long start, long long end) {
+	std::lock_guard<std::mutex> lock(mtx);
+	auto el = tids.find(std::this_thread::get_id());
+	int tid;
+	if(el == tids.end()) {
+		tid = tids.size();
+		tids[std::this_thread::get_id()] = tid;
+	} else {
+		tid = el->second;
+	}
+	events.push_back({name, cat, start, end - start, tid});
+}
+
+void Profiler::hold() {
+	holds++;
+}
+
+void Profiler::release() {
+	if(--holds == 0) {
+		write();
+	}
+}
+
+void Profiler::write() {
+	if(!enabled) return;
+	std::lock_guard<std::mutex> lock(mtx);
+	std::ofstream ofs(traceFile);
+	if(!ofs.is_open()) {
+		std::cout << "Cannot write the trace file: " << traceFile << "\n";
+		return;
+	}
+	ofs << "{\"traceEvents\": [\n";
+	for(int i = 0; i < events.size(); i++) {
+		std::string N;
+		for(char c : events[i].name) {
+			if((c == '"') || (c == '\\')) N += '\\';
+			N += c;
+		}
+		ofs << "  {\"name\": \"" << N << "\", \"cat\": \"" << events[i].cat
+			<< "\", \"ph\": \"X\", \"ts\": " << events[i].start << ", \"dur\": " << events[i].dur
+			<< ", \"pid\": 1, \"tid\": " << events[i].tid << "}" << (i < events.size() - 1 ? ",\n" : "\n");
+	}
+	ofs << "],\n\"displayTimeUnit\": \"ms\"}\n";
+	std::cout << "Startup trace (" << events.size() << " events) written to: " << traceFile << "\n";
+	// only the startup is traced
+	events.clear();
+	enabled = false;
+}
+
+ProfileScope::ProfileScope(std::string _name, const char *_cat) {
+	running = Profiler::enabled;
+	if(running) {
+		name = _name;
+		cat = _cat;
+		start = Profiler::now();
+	}
+}
+
+void ProfileScope::end() {
+	if(running) {
+		Profiler::record(name, cat, start, Profiler::now());
+		running = false;
+	}
+}
+
+void ProfileScope::next(std::string _name) {
+	end();
+	running = Profiler::enabled;
+	if(running) {
+		name = _name;
+		start = Profiler::now();
+	}
+}
+
+void ThreadPool::init(int nThreads) {
+	if(nThreads <= 0) {
+		nThreads = std::max(1, (int)std::thread::hardware_concurrency() - 1);
+	}
+	quit = false;
+	for(int i = 0; i < nThreads; i++) {
+		workers.push_back(std::thread(&ThreadPool::workerLoop, this));
+	}
+}
+
+std::future<void> ThreadPool::submit(std::function<void()> job) {
+	// the packaged task carries exceptions back to whoever waits on the future
+	auto task = std::make_shared<std::packaged_task<void()>>(job);
+	std::future<void> f = task->get_future();
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		jobs.push_back([task] {(*task)();});
+	}
+	cv.notify_one();
+	return f;
+}
+
+void ThreadPool::workerLoop() {
+	while(true) {
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, [this] {return quit || !jobs.empty();});
+			if(jobs.empty()) return;
+			job = std::move(jobs.front());
+			jobs.pop_front();
+		}
+		job();
+	}
+}
+
+void ThreadPool::cleanup() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		quit = true;
+	}
+	cv.notify_all();
+	for(auto &w : workers) {
+		w.join();
+	}
+	workers.clear();
+}
+
+
+void TextureStreamer::add(BaseProject *bp, Texture *T) {
+	BP = bp;
+	textures.push_back(T);
+	if(!worker.joinable()) {
+		quit = false;
+		worker = std::thread(&TextureStreamer::workerLoop, this);
+	}
+}
+
+void TextureStreamer::markUsed(Texture *T, float distance) {
+	if(!T->streaming) return;
+	uint32_t mip = 0;
+	if(distance > fullResDistance) {
+		mip = static_cast<uint32_t>(std::floor(std::log2(distance / fullResDistance)));
+	}
+	mip = std::min(mip, T->tailMip);
+	// several users in the same frame: keep the most detailed request
+	if((T->lastUsedFrame != frame + 1) || (mip < T->wantedMip)) {
+		T->wantedMip = mip;
+	}
+	T->lastUsedFrame = frame + 1;
+}
+
+VkDeviceSize TextureStreamer::getResidentBytes() {
+	VkDeviceSize tot = 0;
+	for(auto T : textures) {
+		uint32_t m = T->streamPending ? std::min(T->residentMip, T->pendingMip) : T->residentMip;
+		tot += T->mipChainBytes(m);
+	}
+	return tot;
+}
+
+void TextureStreamer::request(Texture *T, uint32_t mip) {
+	T->streamPending = true;
+	T->pendingMip = mip;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		pending.push_back({T, mip, {}, 0, 0});
+	}
+	cv.notify_one();
+}
+
+// Drops least recently used textures back to their tail until needed bytes fit
+bool TextureStreamer::makeRoom(VkDeviceSize needed, VkDeviceSize &resident) {
+	if(resident + needed <= budget) return true;
+
+	std::vector<Texture *> lru;
+	for(auto T : textures) {
+		if(!T->streamPending && (T->residentMip < T->tailMip) && (T->lastUsedFrame < frame)) {
+			lru.push_back(T);
+		}
+	}
+	std::sort(lru.begin(), lru.end(), [](Texture *a, Texture *b) {return a->lastUsedFrame < b->lastUsedFrame;});
+	for(auto T : lru) {
+		if(resident + needed <= budget) break;
+		resident -= T->mipChainBytes(T->residentMip) - T->mipChainBytes(T->tailMip);
+		T->wantedMip = T->tailMip;
+		request(T, T->tailMip);
+	}
+	return resident + needed <= budget;
+}
+
+void TextureStreamer::update() {
+	frame++;
+	releaseRetired();
+	if(textures.size() == 0) return;
+
+	// raise the residency of the textures used in the last frame
+	VkDeviceSize resident = getResidentBytes();
+	makeRoom(0, resident);
+	for(auto T : textures) {
+		if(T->streamPending || (T->lastUsedFrame < frame) || (T->wantedMip >= T->residentMip)) continue;
+		uint32_t mip = T->wantedMip;
+		while((mip < T->residentMip) &&
+			  !makeRoom(T->mipChainBytes(mip) - T->mipChainBytes(T->residentMip), resident)) {
+			mip++;
+		}
+		if(mip < T->residentMip) {
+			resident += T->mipChainBytes(mip) - T->mipChainBytes(T->residentMip);
+			request(T, mip);
+		}
+	}
+
+	// swap in the images decoded by the worker
+	std::vector<TextureStreamRequest> done;
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		done.swap(ready);
+	}
+	for(auto &R : done) {
+		Texture *T = R.T;
+		if(R.pixels.size() == 0) {
+			T->streamPending = false;
+			continue;
+		}
+
+		// the texture stays pending until the old image has been released
+		retire(T, T->textureImage, T->textureImageMemory, T->textureImageView);
+		T->createTextureImageFromPixels(R.pixels.data(), R.w, R.h, T->streamFmt);
+		T->createTextureImageView(T->streamFmt);
+		T->residentMip = R.mip;
+	}
+}
+
+void TextureStreamer::retire(Texture *T, VkImage image, VkDeviceMemory memory, VkImageView view, VkSampler sampler) {
+	BP = T->BP;
+	retired.push_back({T, image, memory, view, sampler,
+					   std::vector<bool>(BP->swapChainImages.size(), false), 0});
+}
+
+void TextureStreamer::releaseRetired() {
+	for(int i = retired.size() - 1; i >= 0; i--) {
+		Retired &Rt = retired[i];
+		if(Rt.rebound.size() != BP->swapChainImages.size()) {
+			// the descriptor sets have been created again with the new views
+			Rt.rebound.assign(BP->swapChainImages.size(), true);
+			Rt.freeFrame = frame + MAX_FRAMES_IN_FLIGHT;
+		}
+		if((Rt.freeFrame > 0) && (frame >= Rt.freeFrame)) {
+			release(Rt);
+			retired.erase(retired.begin() + i);
+		}
+	}
+}
+
+void TextureStreamer::imageAcquired(int imageIndex) {
+	bool changed = false;
+	for(auto &Rt : retired) {
+		if((imageIndex >= Rt.rebound.size()) || Rt.rebound[imageIndex]) continue;
+		BP->rebindTextureView(Rt.view, Rt.T->textureImageView,
+							  (Rt.sampler != VK_NULL_HANDLE) ? Rt.T->textureSampler : VK_NULL_HANDLE, imageIndex);
+		Rt.rebound[imageIndex] = true;
+		changed = true;
+		if(std::find(Rt.rebound.begin(), Rt.rebound.end(), false) == Rt.rebound.end()) {
+			Rt.freeFrame = frame + MAX_FRAMES_IN_FLIGHT;
+		}
+	}
+	// command buffers referencing the updated sets must be recorded again
+	if(changed) {
+		BP->resetCommandBuffersForImage(imageIndex);
+	}
+}
+
+void TextureStreamer::release(Retired &R) {
+	vkDestroyImageView(BP->device, R.view, nullptr);
+	vkDestroyImage(BP->device, R.image, nullptr);
+	BP->freeMemory(R.memory);
+	if(R.sampler != VK_NULL_HANDLE) {
+		// a placeholder, the texture was not streaming this image
+		vkDestroySampler(BP->device, R.sampler, nullptr);
+	} else {
+		R.T->streamPending = false;
+	}
+}
+
+void TextureStreamer::workerLoop() {
+	while(true) {
+		TextureStreamRequest R;
+		{
+			std::unique_lock<std::mutex> lock(mtx);
+			cv.wait(lock, [this] {return quit || !pending.empty();});
+			if(quit) return;
+			R = std::move(pending.front());
+			pending.pop_front();
+		}
+
+		// only the requested level is read, the source is decoded again only
+		// when its mips could not be cached
+		if(R.T->mipFile.empty() || !R.T->readMip(R.mip, R.pixels, R.w, R.h)) {
+			int w, h, ch;
+			stbi_uc* pixels = stbi_load(R.T->streamFile.c_str(), &w, &h, &ch, STBI_rgb_alpha);
+			if(pixels) {
+				R.pixels = downsampleRGBA(pixels, w, h, R.mip, R.w, R.h);
+				stbi_image_free(pixels);
+			} else {
+				R.pixels.clear();
+				std::cout << "Streaming - not found: " << R.T->streamFile << "\n";
+			}
+		}
+
+		std::lock_guard<std::mutex> lock(mtx);
+		ready.push_back(std::move(R));
+	}
+}
+
+void TextureStreamer::cleanup() {
+	{
+		std::lock_guard<std::mutex> lock(mtx);
+		quit = true;
+	}
+	cv.notify_all();
+	if(worker.joinable()) {
+		worker.join();
+	}
+	pending.clear();
+	ready.clear();
+	// called after the device is idle
+	for(auto &Rt : retired) {
+		release(Rt);
+	}
+	retired.clear();
+	textures.clear();
+}
+
+
+
 
 
 
@@ -3636,7 +5897,7 @@ void FrameBufferAttachment::createResources() {
 				samples, format, VK_IMAGE_TILING_OPTIMAL,
 				usage, 0, 
 				VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT,
-				image, mem);
+				image, mem, MEM_ATTACHMENT);
 	view = BP->createImageView(image, format,
 								aspect, 1,
 								VK_IMAGE_VIEW_TYPE_2D, 1);
@@ -3684,7 +5945,7 @@ void FrameBufferAttachment::cleanup() {
 	if(!properties->swapChain) {
 		vkDestroyImageView(BP->device, view, nullptr);
 		vkDestroyImage(BP->device, image, nullptr);
-		vkFreeMemory(BP->device, mem, nullptr);
+		BP->freeMemory(mem);
 	}
 }
 
@@ -3821,6 +6082,44 @@ void RenderPass::create() {
 	}	
 
 	createFramebuffers();
+
+	// resized by the application when the swap chain is recreated
+	if(followsSwapChain() &&
+	   (std::find(BP->swapChainPasses.begin(), BP->swapChainPasses.end(), this) == BP->swapChainPasses.end())) {
+		BP->swapChainPasses.push_back(this);
+	}
+}
+
+bool RenderPass::followsSwapChain() {
+	for(int i = 0; i < properties.size(); i++) {
+		if(properties[i].swapChain) return true;
+	}
+	return false;
+}
+
+void RenderPass::resize(int w, int h) {
+	for (size_t i = 0; i < frameBuffers.size(); i++) {
+		vkDestroyFramebuffer(BP->device, frameBuffers[i], nullptr);
+	}
+	width = w;
+	height = h;
+	count = BP->swapChainImageViews.size();
+
+	for(int i = 0; i < attachments.size(); i++) {
+		if(!properties[i].swapChain) {
+			VkImage oldImage = attachments[i].image;
+			VkDeviceMemory oldMem = attachments[i].mem;
+			VkImageView oldView = attachments[i].view;
+			attachments[i].createResources();
+			// descriptor sets sampling the attachment see the new image
+			BP->rebindTextureView(oldView, attachments[i].view);
+			vkDestroyImageView(BP->device, oldView, nullptr);
+			vkDestroyImage(BP->device, oldImage, nullptr);
+			BP->freeMemory(oldMem);
+		}
+	}
+
+	createFramebuffers();
 }
 
 void RenderPass::begin(VkCommandBuffer commandBuffer, int currentImage) {
@@ -3842,6 +6141,21 @@ void RenderPass::begin(VkCommandBuffer commandBuffer, int currentImage) {
 	
 	vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
 			VK_SUBPASS_CONTENTS_INLINE);
+
+	// dynamic state of all the pipelines used in the pass
+	VkViewport viewport{};
+	viewport.x = 0.0f;
+	viewport.y = 0.0f;
+	viewport.width = (float) width;
+	viewport.height = (float) height;
+	viewport.minDepth = 0.0f;
+	viewport.maxDepth = 1.0f;
+	vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+	VkRect2D scissor{};
+	scissor.offset = {0, 0};
+	scissor.extent = {(uint32_t)width, (uint32_t)height};
+	vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
 }
 
 void RenderPass::end(VkCommandBuffer commandBuffer) {
@@ -4071,6 +6385,7 @@ void Pipeline::init(BaseProject *bp, VertexDescriptor *vd,
 					std::vector<VkPushConstantRange> pk) {
 	BP = bp;
 	VD = vd;
+	name = VertShader + " + " + FragShader;
 	
 	auto vertShaderCode = readFile(VertShader);
 	auto fragShaderCode = readFile(FragShader);
@@ -4116,6 +6431,7 @@ void Pipeline::setTopology(VkPrimitiveTopology _topology) {
 
 
 void Pipeline::create(RenderPass *RP) {	
+	ProfileScope PS("Pipeline::create " + name, "pipeline");
 	VkPipelineShaderStageCreateInfo vertShaderStageInfo{};
     vertShaderStageInfo.sType =
     		VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
@@ -4152,25 +6468,21 @@ void Pipeline::create(RenderPass *RP) {
 	inputAssembly.topology = topology;
 	inputAssembly.primitiveRestartEnable = VK_FALSE;
 
-	VkViewport viewport{};
-	viewport.x = 0.0f;
-	viewport.y = 0.0f;
-	viewport.width = (float) RP->width;
-	viewport.height = (float) RP->height;
-	viewport.minDepth = 0.0f;
-	viewport.maxDepth = 1.0f;
-	
-	VkRect2D scissor{};
-	scissor.offset = {0, 0};
-	scissor.extent = {(uint32_t)RP->width, (uint32_t)RP->height};
-	
+	// viewport and scissor are set by RenderPass::begin(), so the pipeline
+	// does not depend on the size of the render target
 	VkPipelineViewportStateCreateInfo viewportState{};
 	viewportState.sType =
 			VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewportState.viewportCount = 1;
-	viewportState.pViewports = &viewport;
+	viewportState.pViewports = nullptr;
 	viewportState.scissorCount = 1;
-	viewportState.pScissors = &scissor;
+	viewportState.pScissors = nullptr;
+
+	VkDynamicState dynamicStates[] = {VK_DYNAMIC_STATE_VIEWPORT, VK_DYNAMIC_STATE_SCISSOR};
+	VkPipelineDynamicStateCreateInfo dynamicState{};
+	dynamicState.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicState.dynamicStateCount = 2;
+	dynamicState.pDynamicStates = dynamicStates;
 	
 	VkPipelineRasterizationStateCreateInfo rasterizer{};
 	rasterizer.sType =
@@ -4282,14 +6594,14 @@ void Pipeline::create(RenderPass *RP) {
 	pipelineInfo.pMultisampleState = &multisampling;
 	pipelineInfo.pDepthStencilState = &depthStencil;
 	pipelineInfo.pColorBlendState = &colorBlending;
-	pipelineInfo.pDynamicState = nullptr; // Optional
+	pipelineInfo.pDynamicState = &dynamicState;
 	pipelineInfo.layout = pipelineLayout;
 	pipelineInfo.renderPass = RP->renderPass;
 	pipelineInfo.subpass = 0;
 	pipelineInfo.basePipelineHandle = VK_NULL_HANDLE; // Optional
 	pipelineInfo.basePipelineIndex = -1; // Optional
 	
-	result = vkCreateGraphicsPipelines(BP->device, VK_NULL_HANDLE, 1,
+	result = vkCreateGraphicsPipelines(BP->device, BP->pipelineCache, 1,
 			&pipelineInfo, nullptr, &graphicsPipeline);
 	if (result != VK_SUCCESS) {
 	 	PrintVkError(result);
@@ -4392,7 +6704,7 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 				BP->createBuffer(bufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
 									 	 VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
 									 	 VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
-									 	 uniformBuffers[j][i], uniformBuffersMemory[j][i]);
+									 	 uniformBuffers[j][i], uniformBuffersMemory[j][i], MEM_UNIFORM);
 			}
 			toFree[j] = true;
 		} else {
@@ -4400,22 +6712,10 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 		}
 	}
 	
-	std::vector<VkDescriptorSetLayout> layouts(BP->swapChainImages.size(),
-											   DSL->descriptorSetLayout);
-	VkDescriptorSetAllocateInfo allocInfo{};
-	allocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-	allocInfo.descriptorPool = BP->descriptorPool;
-	allocInfo.descriptorSetCount = static_cast<uint32_t>(BP->swapChainImages.size());
-	allocInfo.pSetLayouts = layouts.data();
 //std::cout << "Allocating\n";	
 	descriptorSets.resize(BP->swapChainImages.size());
-	
-	VkResult result = vkAllocateDescriptorSets(BP->device, &allocInfo,
-										descriptorSets.data());
-	if (result != VK_SUCCESS) {
-		PrintVkError(result);
-		throw std::runtime_error("failed to allocate descriptor sets!");
-	}
+	pool = BP->descriptorAllocator.allocate(DSL, static_cast<uint32_t>(descriptorSets.size()),
+											descriptorSets.data());
 	
 	for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
 //std::cout << "Consdering swap chain image " << i << "\n";	
@@ -4459,6 +6759,10 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 											VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 				descriptorWrites[j].descriptorCount = DSL->Bindings[j].count;
 				descriptorWrites[j].pImageInfo = &imageInfo[DSL->Bindings[j].linkSize];
+				for(int k = 0; k < DSL->Bindings[j].count; k++) {
+					BP->textureBindings.push_back({descriptorSets[i], DSL->Bindings[j].binding, (uint32_t)k,
+												   imageInfo[DSL->Bindings[j].linkSize + k], (int)i});
+				}
 			}
 		}		
 //std::cout << "Updating descriptor sets\n";	
@@ -4469,11 +6773,17 @@ void DescriptorSet::init(BaseProject *bp, DescriptorSetLayout *DSL,
 }
 
 void DescriptorSet::cleanup() {
+	auto &TB = BP->textureBindings;
+	TB.erase(std::remove_if(TB.begin(), TB.end(), [this](const DescriptorTextureBinding &b) {
+				return std::find(descriptorSets.begin(), descriptorSets.end(), b.set) != descriptorSets.end();
+			 }), TB.end());
+	BP->descriptorAllocator.free(Layout, pool, static_cast<uint32_t>(descriptorSets.size()), descriptorSets.data());
+	pool = VK_NULL_HANDLE;
 	for(int j = 0; j < uniformBuffers.size(); j++) {
 		if(toFree[j]) {
 			for (size_t i = 0; i < BP->swapChainImages.size(); i++) {
 				vkDestroyBuffer(BP->device, uniformBuffers[j][i], nullptr);
-				vkFreeMemory(BP->device, uniformBuffersMemory[j][i], nullptr);
+				BP->freeMemory(uniformBuffersMemory[j][i]);
 			}
 		}
 	}
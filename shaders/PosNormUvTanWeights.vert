@@ -10,17 +10,27 @@ layout(binding = 0, set = 1) uniform UniformBufferObject {
 
 
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNorm;
-layout(location = 2) in vec2 inUV;
-layout(location = 3) in uvec4 inJointIndex;
-layout(location = 4) in vec4 inJointWeight;
+layout(location = 1) in vec2 inNormOct;		// octahedral, snorm16
+layout(location = 2) in vec2 inUV;			// half float
+layout(location = 3) in uvec4 inJointIndex;	// u8
+layout(location = 4) in vec4 inJointWeight;	// unorm16
 
 layout(location = 0) out vec3 fragPos;
 layout(location = 1) out vec3 fragNorm;
 layout(location = 2) out vec2 fragUV;
 layout(location = 3) out vec2 debug2;
 
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
 void main() {
+	vec3 inNorm = octDecode(inNormOct);
+
 	if(ubo.debug1.x == 1.0f) {
 		gl_Position = ubo.mvpMat[0] * vec4(inPosition, 1.0);
 		fragPos = (ubo.mMat[0] * vec4(inPosition, 1.0)).xyz;
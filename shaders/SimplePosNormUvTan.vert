@@ -8,16 +8,28 @@ layout(binding = 0, set = 1) uniform UniformBufferObject {
 } ubo;
 
 layout(location = 0) in vec3 inPosition;
-layout(location = 1) in vec3 inNorm;
-layout(location = 2) in vec2 inUV;
-layout(location = 3) in vec4 inTangent;
+layout(location = 1) in vec2 inNormOct;	// octahedral, snorm16
+layout(location = 2) in vec2 inUV;		// half float
+layout(location = 3) in vec2 inTanOct;	// octahedral, y sign is the bitangent sign
 
 layout(location = 0) out vec3 fragPos;
 layout(location = 1) out vec3 fragNorm;
 layout(location = 2) out vec2 fragUV;
 layout(location = 3) out vec4 fragTan;
 
+vec3 octDecode(vec2 e) {
+	vec3 n = vec3(e.xy, 1.0 - abs(e.x) - abs(e.y));
+	if(n.z < 0.0) {
+		n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return normalize(n);
+}
+
 void main() {
+	vec3 inNorm = octDecode(inNormOct);
+	vec4 inTangent = vec4(octDecode(vec2(inTanOct.x, abs(inTanOct.y) * 2.0 - 1.0)),
+						  inTanOct.y < 0.0 ? -1.0 : 1.0);
+
 	gl_Position = ubo.mvpMat[gl_InstanceIndex] * vec4(inPosition, 1.0);
 	fragPos = (ubo.mMat[gl_InstanceIndex] * vec4(inPosition, 1.0)).xyz;
 	fragNorm = normalize((ubo.nMat[gl_InstanceIndex] * vec4(inNorm, 0.0)).xyz);
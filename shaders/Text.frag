@@ -1,16 +1,18 @@
-#version 450#extension GL_ARB_separate_shader_objects : enable
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
 
 layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) flat in vec4 FGcolor;
+layout(location = 2) flat in vec4 BGcolor;
+layout(location = 3) flat in vec4 SHcolor;
 
 layout(location = 0) out vec4 outColor;
 
 layout(binding = 0) uniform sampler2D texSampler;
 
-layout(push_constant) uniform PushConsts {	vec4 FGcolor;
-	vec4 BGcolor;
-	vec4 SHcolor;} pushConsts;
-
 void main() {
 	vec4 Tx = texture(texSampler, fragTexCoord);
-	outColor = Tx.r * pushConsts.FGcolor +			   Tx.g * pushConsts.BGcolor +			   Tx.b * pushConsts.SHcolor;
-}
\ No newline at end of file
+	outColor = Tx.r * FGcolor +
+			   Tx.g * BGcolor +
+			   Tx.b * SHcolor;
+}
@@ -1,10 +1,42 @@
 #version 450
 #extension GL_ARB_separate_shader_objects : enable
-layout(location = 0) in vec2 inPos;
-layout(location = 1) in vec2 inUV;
+
+// one instance per glyph
+layout(location = 0) in vec4 inRect;
+layout(location = 1) in vec4 inUV;
+layout(location = 2) in vec4 inAnchor;
+layout(location = 3) in uint inColor;
+
+layout(binding = 1) uniform TextUniforms {
+	mat4 ViewPrj;
+	vec4 colors[3 * 64];
+} ubo;
 
 layout(location = 0) out vec2 fragTexCoord;
-void main() {
-	gl_Position = vec4(inPos, 0.0, 1.0);
-	fragTexCoord = inUV;
-}
\ No newline at end of file
+layout(location = 1) flat out vec4 FGcolor;
+layout(location = 2) flat out vec4 BGcolor;
+layout(location = 3) flat out vec4 SHcolor;
+
+// two triangles of the unit quad
+const vec2 corners[6] = vec2[](vec2(0.0, 0.0), vec2(1.0, 0.0), vec2(0.0, 1.0),
+							   vec2(1.0, 0.0), vec2(0.0, 1.0), vec2(1.0, 1.0));
+
+void main() {
+	vec2 c = corners[gl_VertexIndex];
+	vec2 pos = mix(inRect.xy, inRect.zw, c);
+	if(inAnchor.w > 0.0) {
+		// world labels are placed at the projection of their anchor, and
+		// hidden when it is behind the camera
+		vec4 clipPos = ubo.ViewPrj * vec4(inAnchor.xyz, 1.0);
+		if((clipPos.w <= 0.0) || (clipPos.z >= clipPos.w)) {
+			pos = vec2(2.0);
+		} else {
+			pos += clipPos.xy / clipPos.w;
+		}
+	}
+	gl_Position = vec4(pos, 0.0, 1.0);
+	fragTexCoord = mix(inUV.xy, inUV.zw, c);
+	FGcolor = ubo.colors[3 * inColor];
+	BGcolor = ubo.colors[3 * inColor + 1];
+	SHcolor = ubo.colors[3 * inColor + 2];
+}
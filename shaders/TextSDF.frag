@@ -0,0 +1,22 @@
+#version 450
+#extension GL_ARB_separate_shader_objects : enable
+
+layout(location = 0) in vec2 fragTexCoord;
+layout(location = 1) flat in vec4 FGcolor;
+layout(location = 2) flat in vec4 BGcolor;
+layout(location = 3) flat in vec4 SHcolor;
+
+layout(location = 0) out vec4 outColor;
+
+// distance fields of the fill, stroke and shadow: 0.5 on the edges
+layout(binding = 0) uniform sampler2D texSampler;
+
+void main() {
+	vec3 D = texture(texSampler, fragTexCoord).rgb;
+	// edges are smoothed over about one pixel, at any scale
+	vec3 w = max(fwidth(D) * 0.7, vec3(0.001));
+	vec3 Tx = smoothstep(vec3(0.5) - w, vec3(0.5) + w, D);
+	outColor = Tx.r * FGcolor +
+			   Tx.g * BGcolor +
+			   Tx.b * SHcolor;
+}
@@ -1,11 +1,18 @@
 // This module contains the implementation of the library, to speed up the compilation of the main file
 
 #define  STARTER_IMPLEMENTATION
+#define  INFLATE_IMPLEMENTATION		// included by Starter.hpp
 #include "modules/Starter.hpp"
 
+#define  FONTS_IMPLEMENTATION
+#include "modules/Fonts.hpp"
+
 #define  TEXTMAKER_IMPLEMENTATION
 #include "modules/TextMaker.hpp"
 
+#define  SCENEBLOB_IMPLEMENTATION
+#include "modules/SceneBlob.hpp"
+
 #define  SCENE_IMPLEMENTATION
 #include "modules/Scene.hpp"
 
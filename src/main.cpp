@@ -14,18 +14,22 @@
 #include <vulkan/vulkan_core.h>
 
 #include "modules/Starter.hpp"
+#include "modules/Fonts.hpp"
 #include "modules/TextMaker.hpp"
+#include "modules/SceneBlob.hpp"
 #include "modules/Scene.hpp"
 #include "modules/Animations.hpp"
 // #include "../src/Libs.cpp"
 
 // The uniform buffer object used in this example
+// Packed layouts: octahedral normal / tangent (snorm16), half float UVs,
+// u8 joint indices and unorm16 weights. Decoded in the vertex shaders.
 struct VertexChar {
   glm::vec3 pos;
-  glm::vec3 norm;
-  glm::vec2 UV;
-  glm::uvec4 jointIndices;
-  glm::vec4 weights;
+  glm::i16vec2 norm;
+  glm::u16vec2 UV;
+  glm::u8vec4 jointIndices;
+  glm::u16vec4 weights;
 };
 
 struct VertexSimp {
@@ -40,9 +44,9 @@ struct skyBoxVertex {
 
 struct VertexTan {
   glm::vec3 pos;
-  glm::vec3 norm;
-  glm::vec2 UV;
-  glm::vec4 tan;
+  glm::i16vec2 norm;
+  glm::u16vec2 UV;
+  glm::i16vec2 tan;
 };
 
 struct GlobalUniformBufferObject {
@@ -66,7 +70,6 @@ struct UniformBufferObjectSimp {
 
 struct ComponentModel {
   Model model;
-  DescriptorSet previewDescriptorSet;
   DescriptorSet standardDescriptorSet;
 };
 
@@ -110,8 +113,14 @@ protected:
   Structure minerStructure, conveyorStructure, furnaceStructure,
       mineralMinedStructure, metalIngotStructure, coalStructure;
   bool isPlacing = false;
+  bool showMemory = false; // GPU memory overlay, toggled with M
+  float memElapsedT = 1.0f; // time since the overlay was refreshed
+  bool firstFrameDone = false; // time to the first frame already reported
   glm::mat4 previewTransform;
   float previewRotation = 0.0f;
+  // sets of the components being placed: they are transient, allocated
+  // every frame while placing
+  std::vector<VkDescriptorSet> previewSets;
   DescriptorSet DSgrid, DSglobal;
 
   const glm::vec4 validColorWRF = glm::vec4(0.0f, 1.0f, 1.0f, 1.0f);   // Cyan
@@ -226,6 +235,7 @@ protected:
     glfwSetMouseButtonCallback(window, mouse_button_callback);
 
     // Descriptor Layouts [what will be passed to the shaders]
+    ProfileScope PS("localInit: descriptor set layouts");
     DSLglobal.init(
         this,
         {// this array contains the binding:
@@ -305,18 +315,19 @@ protected:
                               VK_SHADER_STAGE_VERTEX_BIT,
                               sizeof(UniformBufferObjectSimp), 1}});
 
+    PS.next("localInit: vertex descriptors");
     VDchar.init(
         this, {{0, sizeof(VertexChar), VK_VERTEX_INPUT_RATE_VERTEX}},
         {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexChar, pos),
           sizeof(glm::vec3), POSITION},
-         {0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexChar, norm),
-          sizeof(glm::vec3), NORMAL},
-         {0, 2, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexChar, UV),
-          sizeof(glm::vec2), UV},
-         {0, 3, VK_FORMAT_R32G32B32A32_UINT, offsetof(VertexChar, jointIndices),
-          sizeof(glm::uvec4), JOINTINDEX},
-         {0, 4, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(VertexChar, weights),
-          sizeof(glm::vec4), JOINTWEIGHT}});
+         {0, 1, VK_FORMAT_R16G16_SNORM, offsetof(VertexChar, norm),
+          sizeof(glm::i16vec2), NORMAL},
+         {0, 2, VK_FORMAT_R16G16_SFLOAT, offsetof(VertexChar, UV),
+          sizeof(glm::u16vec2), UV},
+         {0, 3, VK_FORMAT_R8G8B8A8_UINT, offsetof(VertexChar, jointIndices),
+          sizeof(glm::u8vec4), JOINTINDEX},
+         {0, 4, VK_FORMAT_R16G16B16A16_UNORM, offsetof(VertexChar, weights),
+          sizeof(glm::u16vec4), JOINTWEIGHT}});
 
     VDsimp.init(this, {{0, sizeof(VertexSimp), VK_VERTEX_INPUT_RATE_VERTEX}},
                 {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexSimp, pos),
@@ -334,12 +345,12 @@ protected:
     VDtan.init(this, {{0, sizeof(VertexTan), VK_VERTEX_INPUT_RATE_VERTEX}},
                {{0, 0, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexTan, pos),
                  sizeof(glm::vec3), POSITION},
-                {0, 1, VK_FORMAT_R32G32B32_SFLOAT, offsetof(VertexTan, norm),
-                 sizeof(glm::vec3), NORMAL},
-                {0, 2, VK_FORMAT_R32G32_SFLOAT, offsetof(VertexTan, UV),
-                 sizeof(glm::vec2), UV},
-                {0, 3, VK_FORMAT_R32G32B32A32_SFLOAT, offsetof(VertexTan, tan),
-                 sizeof(glm::vec4), TANGENT}});
+                {0, 1, VK_FORMAT_R16G16_SNORM, offsetof(VertexTan, norm),
+                 sizeof(glm::i16vec2), NORMAL},
+                {0, 2, VK_FORMAT_R16G16_SFLOAT, offsetof(VertexTan, UV),
+                 sizeof(glm::u16vec2), UV},
+                {0, 3, VK_FORMAT_R16G16_SNORM, offsetof(VertexTan, tan),
+                 sizeof(glm::i16vec2), TANGENT}});
 
     // Grid vertex descriptor - no vertex attributes since positions are
     // hardcoded in shader
@@ -353,6 +364,7 @@ protected:
     VDRs[4].init("VDgrid", &VDgrid);
 
     // initializes the render passes
+    PS.next("localInit: pipelines");
     RP.init(this);
     // sets the blue sky
     RP.properties[0].clearValue = {0.0f, 0.9f, 1.0f, 1.0f};
@@ -398,28 +410,29 @@ protected:
                {&DSLgrid});
 
     Pgrid.setTransparency(true);
+
+    PS.next("localInit: structure models");
     minerStructure.components.resize(4);
 
-    AssetFile assetMiner;
-    assetMiner.init("assets/models/miner/miner.gltf", GLTF);
-    minerStructure.components[0].model.initFromAsset(this, &VDtan, &assetMiner,
-                                                     "Cube.006", 0, "Cube.006");
-    minerStructure.components[1].model.initFromAsset(this, &VDtan, &assetMiner,
-                                                     "Cone", 0, "Cone");
-    minerStructure.components[2].model.initFromAsset(this, &VDtan, &assetMiner,
-                                                     "Cube", 0, "Cube");
-    minerStructure.components[3].model.initFromAsset(this, &VDtan, &assetMiner,
-                                                     "Cylinder", 0, "Cylinder");
+    std::string assetMiner = "assets/models/miner/miner.gltf";
+    minerStructure.components[0].model.initFromAsset(
+        this, &VDtan, assetMiner, GLTF, "Cube.006", 0, "Cube.006");
+    minerStructure.components[1].model.initFromAsset(
+        this, &VDtan, assetMiner, GLTF, "Cone", 0, "Cone");
+    minerStructure.components[2].model.initFromAsset(
+        this, &VDtan, assetMiner, GLTF, "Cube", 0, "Cube");
+    minerStructure.components[3].model.initFromAsset(
+        this, &VDtan, assetMiner, GLTF, "Cylinder", 0, "Cylinder");
 
     conveyorStructure.components.resize(3);
-    AssetFile assetConveyor;
-    assetConveyor.init("assets/models/conveyor_belt/conveyor_belt.gltf", GLTF);
+    std::string assetConveyor =
+        "assets/models/conveyor_belt/conveyor_belt.gltf";
     conveyorStructure.components[0].model.initFromAsset(
-        this, &VDtan, &assetConveyor, "Cube.001", 0, "Cube.001");
+        this, &VDtan, assetConveyor, GLTF, "Cube.001", 0, "Cube.001");
     conveyorStructure.components[1].model.initFromAsset(
-        this, &VDtan, &assetConveyor, "Cube.002", 0, "Cube.002");
+        this, &VDtan, assetConveyor, GLTF, "Cube.002", 0, "Cube.002");
     conveyorStructure.components[2].model.initFromAsset(
-        this, &VDtan, &assetConveyor, "Cube.003", 0, "Cube.003");
+        this, &VDtan, assetConveyor, GLTF, "Cube.003", 0, "Cube.003");
 
     // for (auto &component : conveyorStructure.components) {
     //   component.model.Wm = glm::rotate(glm::mat4(1.0f), glm::radians(-90.0f),
@@ -439,37 +452,37 @@ protected:
     // conveyorStructure.components[2].model.Wm;
 
     furnaceStructure.components.resize(3);
-    AssetFile assetFurnace;
-    assetFurnace.init("assets/models/furnace_new/furnace.gltf", GLTF);
+    std::string assetFurnace = "assets/models/furnace_new/furnace.gltf";
     furnaceStructure.components[0].model.initFromAsset(
-        this, &VDtan, &assetFurnace, "LP_coal_Coal_0", 0, "LP_coal_Coal_0");
+        this, &VDtan, assetFurnace, GLTF, "LP_coal_Coal_0", 0,
+        "LP_coal_Coal_0");
     furnaceStructure.components[1].model.initFromAsset(
-        this, &VDtan, &assetFurnace, "LP_rail_Metal_0", 0, "LP_rail_Metal_0");
+        this, &VDtan, assetFurnace, GLTF, "LP_rail_Metal_0", 0,
+        "LP_rail_Metal_0");
     furnaceStructure.components[2].model.initFromAsset(
-        this, &VDtan, &assetFurnace, "LP_rail_Metal_0", 1, "LP_rail_Metal_0");
+        this, &VDtan, assetFurnace, GLTF, "LP_rail_Metal_0", 1,
+        "LP_rail_Metal_0");
 
     mineralMinedStructure.components.resize(1);
-    AssetFile assetMineralMined;
-    assetMineralMined.init("assets/models/mineral_mined/Asteroid_1b.gltf",
-                           GLTF);
+    std::string assetMineralMined =
+        "assets/models/mineral_mined/Asteroid_1b.gltf";
     mineralMinedStructure.components[0].model.initFromAsset(
-        this, &VDtan, &assetMineralMined, "Asteroid_1b", 0, "Asteroid_1b");
+        this, &VDtan, assetMineralMined, GLTF, "Asteroid_1b", 0,
+        "Asteroid_1b");
     mineralMinedStructure.components[0].model.Wm =
         glm::scale(glm::vec3(0.4)) *
         mineralMinedStructure.components[0].model.Wm;
 
     metalIngotStructure.components.resize(1);
-    AssetFile assetMetalIngot;
-    assetMetalIngot.init("assets/models/metal_ingot/scene.gltf", GLTF);
+    std::string assetMetalIngot = "assets/models/metal_ingot/scene.gltf";
     metalIngotStructure.components[0].model.initFromAsset(
-        this, &VDtan, &assetMetalIngot, "Ingot_LP_Ingot_0", 0,
+        this, &VDtan, assetMetalIngot, GLTF, "Ingot_LP_Ingot_0", 0,
         "Ingot_LP_Ingot_0");
 
     coalStructure.components.resize(1);
-    AssetFile assetCoalStructure;
-    assetCoalStructure.init("assets/models/coal/scene.gltf", GLTF);
+    std::string assetCoalStructure = "assets/models/coal/scene.gltf";
     coalStructure.components[0].model.initFromAsset(
-        this, &VDtan, &assetCoalStructure, "Object_0", 0, "Object_2");
+        this, &VDtan, assetCoalStructure, GLTF, "Object_0", 0, "Object_2");
     coalStructure.components[0].model.Wm =
         glm::scale(glm::vec3(0.05)) * coalStructure.components[0].model.Wm;
 
@@ -560,12 +573,13 @@ protected:
 
     // Models, textures and Descriptors (values assigned to the uniforms)
 
-    // sets the size of the Descriptor Set Pool
+    // initial size of the Descriptor Set Pool (it grows when needed)
     DPSZs.uniformBlocksInPool = 100;
     DPSZs.texturesInPool = 100;
     DPSZs.setsInPool = 100;
 
     std::cout << "\nLoading the scene\n\n";
+    PS.next("localInit: Scene::init");
     if (SC.init(this, /*Npasses*/ 1, VDRs, PRs, "assets/models/scene.json") !=
         0) {
       std::cout << "ERROR LOADING THE SCENE\n";
@@ -587,16 +601,19 @@ protected:
           glm::translate(glm::mat4(1.f), glm::vec3(-0.f, 0.f, -1.5f)) *
           SC.TI[0].I[i].Wm[3];
     }
-    // initializes the textual output
-    txt.init(this, windowWidth, windowHeight);
+    // initializes the textual output, drawn at the end of the main pass
+    PS.next("localInit: txt.init");
+    txt.useSDF("assets/textures/Fonts_CO.fsdf");
+    txt.initOverlay(this, &RP, windowWidth, windowHeight);
+    PS.end();
 
     // submits the main command buffer
-    submitCommandBuffer("main", 0, populateCommandBufferAccess, this);
+    submitMainCommandBuffer();
 
     // Prepares for showing the FPS count
-    txt.print(1.0f, 1.0f, "FPS:", 1, "CO", false, false, true, TAL_RIGHT,
-              TRH_RIGHT, TRV_BOTTOM, {1.0f, 0.0f, 0.0f, 1.0f},
-              {0.8f, 0.8f, 0.0f, 1.0f});
+    txt.printNumber(1.0f, 1.0f, "FPS: ", 4, 0, 1, "CO", false, false, true,
+                    TAL_RIGHT, TRH_RIGHT, TRV_BOTTOM, {1.0f, 0.0f, 0.0f, 1.0f},
+                    {0.8f, 0.8f, 0.0f, 1.0f});
     txt.print(0.0f, 0.0f, "+", 2, "CO", false, false, true, TAL_CENTER,
               TRH_CENTER, TRV_MIDDLE, {1.0f, 0.0f, 0.0f, 1.0f},
               {0.8f, 0.8f, 0.0f, 1.0f});
@@ -619,6 +636,9 @@ protected:
     txt.print(0.0f, 0.0f, "Needed: 25 Iron", 11, "CO", false, false, true,
               TAL_CENTER, TRH_CENTER, TRV_TOP, {1.0f, 1.0f, 1.0f, 1.0f},
               {0.0f, 0.0f, 0.0f, 1.0f});
+
+    // the scene keeps loading while the first frames are shown
+    showLoadingProgress();
   }
 
   // Here you create your pipelines and Descriptor Sets!
@@ -626,45 +646,30 @@ protected:
     // creates the render pass
     RP.create();
 
-    // This creates a new pipeline (with the current surface), using its shaders
-    // for the provided render pass
-    Pchar.create(&RP);
-    P_Ground.create(&RP);
-    PskyBox.create(&RP);
-    P_PBR.create(&RP);
-    Pwireframe.create(&RP);
-    Pgrid.create(&RP);
-    P_PBRCoal.create(&RP);
+    // This creates the pipelines (with the current surface), using their
+    // shaders for the provided render pass: they are compiled in parallel
+    createPipelines(&RP, {&Pchar, &P_Ground, &PskyBox, &P_PBR, &Pwireframe,
+                          &Pgrid, &P_PBRCoal});
 
     // init miner components
-    minerStructure.components[0].previewDescriptorSet.init(this, &DSLwireframe,
-                                                           {});
     minerStructure.components[0].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[45]->getViewAndSampler(), SC.T[46]->getViewAndSampler(),
          SC.T[47]->getViewAndSampler(), SC.T[48]->getViewAndSampler()});
-    minerStructure.components[1].previewDescriptorSet.init(this, &DSLwireframe,
-                                                           {});
     minerStructure.components[1].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[57]->getViewAndSampler(), SC.T[58]->getViewAndSampler(),
          SC.T[59]->getViewAndSampler(), SC.T[60]->getViewAndSampler()});
-    minerStructure.components[2].previewDescriptorSet.init(this, &DSLwireframe,
-                                                           {});
     minerStructure.components[2].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[53]->getViewAndSampler(), SC.T[54]->getViewAndSampler(),
          SC.T[55]->getViewAndSampler(), SC.T[56]->getViewAndSampler()});
-    minerStructure.components[3].previewDescriptorSet.init(this, &DSLwireframe,
-                                                           {});
     minerStructure.components[3].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[49]->getViewAndSampler(), SC.T[50]->getViewAndSampler(),
          SC.T[51]->getViewAndSampler(), SC.T[52]->getViewAndSampler()});
 
     //    for (auto &component : minerStructure.components) {
-    //      component.previewDescriptorSet.init(this, &DSLwireframe, {});
-    //
     //      component.standardDescriptorSet.init(
     //          this, &DSLlocalPBR,
     //          {SC.T[0]->getViewAndSampler(), SC.T[1]->getViewAndSampler(),
@@ -672,65 +677,47 @@ protected:
     //    }
 
     // init conveyor components
-    conveyorStructure.components[0].previewDescriptorSet.init(
-        this, &DSLwireframe, {});
     conveyorStructure.components[0].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[11]->getViewAndSampler(), SC.T[11]->getViewAndSampler(),
          SC.T[11]->getViewAndSampler(), SC.T[11]->getViewAndSampler()});
-    conveyorStructure.components[1].previewDescriptorSet.init(
-        this, &DSLwireframe, {});
     conveyorStructure.components[1].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[11]->getViewAndSampler(), SC.T[11]->getViewAndSampler(),
          SC.T[11]->getViewAndSampler(), SC.T[11]->getViewAndSampler()});
-    conveyorStructure.components[2].previewDescriptorSet.init(
-        this, &DSLwireframe, {});
     conveyorStructure.components[2].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[10]->getViewAndSampler(), SC.T[10]->getViewAndSampler(),
          SC.T[10]->getViewAndSampler(), SC.T[10]->getViewAndSampler()});
 
     // init furnace components
-    furnaceStructure.components[0].previewDescriptorSet.init(this,
-                                                             &DSLwireframe, {});
     furnaceStructure.components[0].standardDescriptorSet.init(
         this, &DSLlocalPBRCoal,
         {SC.T[15]->getViewAndSampler(), SC.T[18]->getViewAndSampler(),
          SC.T[37]->getViewAndSampler(), SC.T[38]->getViewAndSampler(),
          SC.T[17]->getViewAndSampler()});
 
-    furnaceStructure.components[1].previewDescriptorSet.init(this,
-                                                             &DSLwireframe, {});
     furnaceStructure.components[1].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[19]->getViewAndSampler(), SC.T[21]->getViewAndSampler(),
          SC.T[39]->getViewAndSampler(), SC.T[40]->getViewAndSampler()});
 
-    furnaceStructure.components[2].previewDescriptorSet.init(this,
-                                                             &DSLwireframe, {});
     furnaceStructure.components[2].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[12]->getViewAndSampler(), SC.T[13]->getViewAndSampler(),
          SC.T[35]->getViewAndSampler(), SC.T[36]->getViewAndSampler()});
 
     // init mineral mined structure
-    mineralMinedStructure.components[0].previewDescriptorSet.init(
-        this, &DSLwireframe, {});
     mineralMinedStructure.components[0].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[27]->getViewAndSampler(), SC.T[28]->getViewAndSampler(),
          SC.T[29]->getViewAndSampler(), SC.T[30]->getViewAndSampler()});
 
     // init metal ingot structure
-    metalIngotStructure.components[0].previewDescriptorSet.init(
-        this, &DSLwireframe, {});
     metalIngotStructure.components[0].standardDescriptorSet.init(
         this, &DSLlocalPBR,
         {SC.T[31]->getViewAndSampler(), SC.T[32]->getViewAndSampler(),
          SC.T[33]->getViewAndSampler(), SC.T[34]->getViewAndSampler()});
-    coalStructure.components[0].previewDescriptorSet.init(this, &DSLwireframe,
-                                                          {});
     coalStructure.components[0].standardDescriptorSet.init(
         this, &DSLlocalChar, {SC.T[61]->getViewAndSampler()});
 
@@ -753,31 +740,26 @@ protected:
 
     // Cleanup descriptor sets for each component in minerStructurePreview
     for (auto &component : minerStructure.components) {
-      component.previewDescriptorSet.cleanup();
       component.standardDescriptorSet.cleanup();
     }
 
     // conveyor cleanup
     for (auto &component : conveyorStructure.components) {
-      component.previewDescriptorSet.cleanup();
       component.standardDescriptorSet.cleanup();
     }
 
     // furnace cleanup
     for (auto &component : furnaceStructure.components) {
-      component.previewDescriptorSet.cleanup();
       component.standardDescriptorSet.cleanup();
     }
 
     // mineral mined cleanup
     for (auto &component : mineralMinedStructure.components) {
-      component.previewDescriptorSet.cleanup();
       component.standardDescriptorSet.cleanup();
     }
 
     // metal ingot cleanup
     for (auto &component : metalIngotStructure.components) {
-      component.previewDescriptorSet.cleanup();
       component.standardDescriptorSet.cleanup();
     }
 
@@ -844,10 +826,17 @@ protected:
     Factotum *T = (Factotum *)Params;
     T->populateCommandBuffer(commandBuffer, currentImage);
   }
+  // while placing, the main command buffer is recorded again every frame,
+  // since the preview uses transient descriptor sets
+  void submitMainCommandBuffer() {
+    submitCommandBuffer("main", 0, populateCommandBufferAccess, this, nullptr,
+                        isPlacing);
+  }
   // This is the real place where the Command Buffer is written
   void populateCommandBuffer(VkCommandBuffer commandBuffer, int currentImage) {
     if (isShowingWinScreen) {
       RP.begin(commandBuffer, currentImage);
+      txt.draw(commandBuffer, currentImage);
       RP.end(commandBuffer);
       return;
     }
@@ -973,19 +962,23 @@ protected:
 
       auto color = isPlacementValid ? validColorWRF : invalidColorWRF;
 
-      for (auto &component : selectedStructure->components) {
+      // the sets are missing in the frame in which placing starts
+      auto &components = selectedStructure->components;
+      for (int i = 0; i < previewSets.size() && i < components.size(); i++) {
         Pwireframe.bind(commandBuffer);
 
         vkCmdPushConstants(commandBuffer, Pwireframe.pipelineLayout,
                            VK_SHADER_STAGE_FRAGMENT_BIT, 0, sizeof(glm::vec4),
                            &color);
 
-        component.model.bind(commandBuffer);
-        component.previewDescriptorSet.bind(commandBuffer, Pwireframe, 1,
-                                            currentImage);
-        vkCmdDrawIndexed(commandBuffer,
-                         static_cast<uint32_t>(component.model.indices.size()),
-                         1, 0, 0, 0);
+        components[i].model.bind(commandBuffer);
+        vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                                Pwireframe.pipelineLayout, 1, 1,
+                                &previewSets[i], 0, nullptr);
+        vkCmdDrawIndexed(
+            commandBuffer,
+            static_cast<uint32_t>(components[i].model.indices.size()), 1, 0, 0,
+            0);
       }
 
       // Render grid preview
@@ -994,6 +987,9 @@ protected:
       vkCmdDraw(commandBuffer, 6, 1, 0, 0);
     }
 
+    // the text is the last thing drawn, over the scene
+    txt.draw(commandBuffer, currentImage);
+
     RP.end(commandBuffer);
   }
 
@@ -1004,11 +1000,26 @@ protected:
     static bool debounce = false;
     static int curDebounce = 0;
 
+    // the transient sets of the last frame have been released
+    previewSets.clear();
+
     // handle the ESC key to exit the app
     if (glfwGetKey(window, GLFW_KEY_ESCAPE)) {
       glfwSetWindowShouldClose(window, GL_TRUE);
     }
 
+    if (!firstFrameDone) {
+      firstFrameDone = true;
+      std::cout << "[Startup] First interactive frame after "
+                << Profiler::now() / 1000.0 << " ms\n";
+    }
+
+    // uploads the scene elements decoded since the last frame
+    if (SC.isLoading()) {
+      SC.updateLoading();
+      showLoadingProgress();
+    }
+
     if (glfwGetKey(window, GLFW_KEY_1)) {
       if (!debounce) {
         debounce = true;
@@ -1016,8 +1027,6 @@ protected:
 
         inventoryItem = MINER;
         std::cout << "Selected MINER\n";
-        if (isPlacing)
-          submitCommandBuffer("main", 0, populateCommandBufferAccess, this);
 
         debug1.x = 1.0 - debug1.x;
       }
@@ -1035,8 +1044,6 @@ protected:
 
         inventoryItem = CONVEYOR_BELT;
         std::cout << "Selected CONVEYOR_BELT\n";
-        if (isPlacing)
-          submitCommandBuffer("main", 0, populateCommandBufferAccess, this);
 
         debug1.y = 1.0 - debug1.y;
       }
@@ -1054,8 +1061,6 @@ protected:
 
         inventoryItem = FURNACE;
         std::cout << "Selected FURNACE\n";
-        if (isPlacing)
-          submitCommandBuffer("main", 0, populateCommandBufferAccess, this);
 
         debug1.y = 1.0 - debug1.y;
       }
@@ -1101,7 +1106,7 @@ protected:
         debounce = true;
         curDebounce = GLFW_KEY_T;
         isPlacing = !isPlacing;
-        submitCommandBuffer("main", 0, populateCommandBufferAccess, this);
+        submitMainCommandBuffer();
         std::cout << "Wireframe placement mode: " << (isPlacing ? "ON" : "OFF")
                   << std::endl;
         return;
@@ -1131,9 +1136,31 @@ protected:
       }
     }
 
+    if (glfwGetKey(window, GLFW_KEY_M) == GLFW_PRESS) {
+      if (!debounce) {
+        debounce = true;
+        curDebounce = GLFW_KEY_M;
+        showMemory = !showMemory;
+        memElapsedT = 1.0f;
+        if (!showMemory) {
+          txt.print(0.0f, -2.0f, "", 4, "CO", false, false, true, TAL_LEFT,
+                    TRH_LEFT, TRV_BOTTOM, {1.0f, 1.0f, 1.0f, 1.0f},
+                    {0.0f, 0.0f, 0.0f, 1.0f});
+        }
+      }
+    } else {
+      if ((curDebounce == GLFW_KEY_M) && debounce) {
+        debounce = false;
+        curDebounce = 0;
+      }
+    }
+
     // moves the view
     float deltaT = GameLogic();
 
+    // raises the resolution of the streamed textures in view
+    SC.markTexturesUsed(ViewPrj, cameraPos);
+
     // defines the global parameters for the uniform
     const glm::mat4 lightView = glm::rotate(glm::mat4(1), glm::radians(-30.0f),
                                             glm::vec3(0.0f, 1.0f, 0.0f)) *
@@ -1257,7 +1284,7 @@ protected:
 
               spawnedMinerals.push_back(newMineral);
 
-              submitCommandBuffer("main", 0, populateCommandBufferAccess, this);
+              submitMainCommandBuffer();
               std::cout << "Found conveyour!!\n";
             }
           }
@@ -1351,7 +1378,7 @@ protected:
             spawnedMinerals.push_back(newMineral);
             miner->lastSpawnTime = currentTime;
 
-            submitCommandBuffer("main", 0, populateCommandBufferAccess, this);
+            submitMainCommandBuffer();
           }
         }
       }
@@ -1415,7 +1442,7 @@ protected:
 
       if (!valid) {
         spawnedMinerals.erase(spawnedMinerals.begin() + i);
-        submitCommandBuffer("main", 0, populateCommandBufferAccess, this);
+        submitMainCommandBuffer();
       }
     }
 
@@ -1473,7 +1500,6 @@ protected:
       glm::vec3 placementPos = calculateGroundPlacementPosition(
           cameraPos, getLookingVector(), gridSize);
 
-      bool prevState = isPlacementValid;
       isPlacementValid = true;
 
       if (placementPos.x == 0.0f && placementPos.z == 0.0f) {
@@ -1539,10 +1565,6 @@ protected:
         }
       }
 
-      if (prevState != isPlacementValid) {
-        submitCommandBuffer("main", 0, populateCommandBufferAccess, this);
-      }
-
       UniformBufferObjectSimp ubosComponent{};
       previewTransform =
           glm::translate(glm::mat4(1.0f),
@@ -1571,7 +1593,8 @@ protected:
         ubosComponent.nMat[0] =
             glm::inverse(glm::transpose(ubosComponent.mMat[0]));
 
-        component.previewDescriptorSet.map(currentImage, &ubosComponent, 0);
+        previewSets.push_back(
+            allocateTransientDescriptorSet(&DSLwireframe, {&ubosComponent}));
       }
     }
 
@@ -1585,56 +1608,32 @@ protected:
                 {0.8f, 0.8f, 0.0f, 1.0f});
     }
 
-    // Add labels for placed objects
-    if (!isRocketTakingOff) {
-      for (int i = 0; i < placedObjects.size(); i++) {
-        auto &obj = placedObjects[i];
-        if (obj->type == FURNACE) {
-          glm::vec3 pos = obj->position;
-          glm::vec4 clipPos =
-              ViewPrj * glm::vec4(pos + glm::vec3(0.0f, 1.0f, 0.0f), 1.0);
-          glm::vec3 ndcPos = glm::vec3(clipPos) / clipPos.w;
-
-          if (ndcPos.z < 1.0f && isPlacing) {
-            std::string label = (obj->type == MINER) ? "Miner" : "Furnace";
-            txt.print(ndcPos.x, ndcPos.y, "Miner", 100 + obj->id, "CO", false,
-                      false, true, TAL_CENTER, TRH_CENTER, TRV_BOTTOM,
-                      {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f});
-          } else {
-            txt.print(0.0f, -2.0f, "", 100 + obj->id, "CO", false, false, true,
-                      TAL_CENTER, TRH_CENTER, TRV_BOTTOM,
-                      {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f});
-          }
-        }
-      }
-    }
-
-    // display inventory information
-
-    // Add labels for furnace ore and coal
+    // Labels of the furnaces: they are anchored above each furnace, and
+    // projected on the GPU with the matrix of the current frame
+    txt.setViewPrj(ViewPrj);
     if (!isRocketTakingOff) {
       for (int i = 0; i < placedObjects.size(); i++) {
         auto &obj = placedObjects[i];
         if (obj->type == FURNACE) {
           auto furnace = std::dynamic_pointer_cast<PlacedFurnace>(obj);
-          glm::vec3 pos = obj->position;
-          glm::vec4 clipPos =
-              ViewPrj * glm::vec4(pos + glm::vec3(0.0f, 1.5f, 0.0f), 1.0);
-          glm::vec3 ndcPos = glm::vec3(clipPos) / clipPos.w;
-
-          if (ndcPos.z < 1.0f && isPlacing) {
-            std::stringstream ss_ore, ss_coal;
-            ss_ore << "Ore: " << furnace->ore.size();
-            ss_coal << "Coal: " << furnace->coal.size();
-            txt.print(ndcPos.x, ndcPos.y - 0.1f, "Furnace", 100 + obj->id, "CO",
-                      false, false, true, TAL_CENTER, TRH_CENTER, TRV_BOTTOM,
-                      {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f});
-            txt.print(ndcPos.x, ndcPos.y, ss_ore.str(), 200 + obj->id, "CO",
-                      false, false, true, TAL_CENTER, TRH_CENTER, TRV_BOTTOM,
-                      {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f});
-            txt.print(ndcPos.x, ndcPos.y, ss_coal.str(), 300 + obj->id, "CO",
-                      false, false, true, TAL_CENTER, TRH_CENTER, TRV_TOP,
-                      {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f});
+          glm::vec3 anchor = obj->position + glm::vec3(0.0f, 1.5f, 0.0f);
+
+          if (isPlacing) {
+            // the counters only rewrite their digits when they change
+            txt.printWorld(anchor, 0.0f, -0.1f, "Furnace", 100 + obj->id, "CO",
+                           false, false, true, TAL_CENTER, TRH_CENTER,
+                           TRV_BOTTOM, {1.0f, 1.0f, 1.0f, 1.0f},
+                           {0.0f, 0.0f, 0.0f, 1.0f});
+            txt.printWorldNumber(anchor, 0.0f, 0.0f, "Ore: ", 3,
+                                 (int)furnace->ore.size(), 200 + obj->id, "CO",
+                                 false, false, true, TAL_CENTER, TRH_CENTER,
+                                 TRV_BOTTOM, {1.0f, 1.0f, 1.0f, 1.0f},
+                                 {0.0f, 0.0f, 0.0f, 1.0f});
+            txt.printWorldNumber(anchor, 0.0f, 0.0f, "Coal: ", 3,
+                                 (int)furnace->coal.size(), 300 + obj->id, "CO",
+                                 false, false, true, TAL_CENTER, TRH_CENTER,
+                                 TRV_TOP, {1.0f, 1.0f, 1.0f, 1.0f},
+                                 {0.0f, 0.0f, 0.0f, 1.0f});
           } else {
             txt.print(0.0f, -2.0f, "", 100 + obj->id, "CO", false, false, true,
                       TAL_CENTER, TRH_CENTER, TRV_BOTTOM,
@@ -1701,31 +1700,20 @@ protected:
       isShowingWinScreen = true;
       finalGameTime = glfwGetTime() - gameStartTime;
       RP.properties[0].clearValue = {0.5f, 0.8f, 1.0f, 1.0f};
-      submitCommandBuffer("main", 0, populateCommandBufferAccess, this);
+      submitMainCommandBuffer();
     }
 
     // ROCKET LABEL
     glm::vec3 rocketPos = glm::vec3(SC.TI[3].I[4].Wm[3]);
-    glm::vec4 clipPos = ViewPrj * glm::vec4(rocketPos, 1.0);
-    glm::vec3 ndcPos = glm::vec3(clipPos) / clipPos.w;
     if (!isRocketTakingOff) {
-      if (ndcPos.z < 1.0f) {
-        txt.print(ndcPos.x, ndcPos.y, "Rocket", 10, "CO", false, false, true,
-                  TAL_CENTER, TRH_CENTER, TRV_BOTTOM, {1.0f, 1.0f, 1.0f, 1.0f},
-                  {0.0f, 0.0f, 0.0f, 1.0f});
-        std::stringstream ss;
-        ss << "Needed: " << 25 - rocketIronCount << " Iron";
-        txt.print(ndcPos.x, ndcPos.y + 0.1f, ss.str(), 11, "CO", false, false,
-                  true, TAL_CENTER, TRH_CENTER, TRV_TOP, {1.0f, 1.0f, 1.0f, 1.0f},
-                  {0.0f, 0.0f, 0.0f, 1.0f});
-      } else {
-        txt.print(0.0f, -2.0f, "Rocket", 10, "CO", false, false, true, TAL_CENTER,
-                  TRH_CENTER, TRV_BOTTOM, {1.0f, 1.0f, 1.0f, 1.0f},
-                  {0.0f, 0.0f, 0.0f, 1.0f});
-        txt.print(0.0f, -2.0f, "", 11, "CO", false, false, true, TAL_CENTER,
-                  TRH_CENTER, TRV_TOP, {1.0f, 1.0f, 1.0f, 1.0f},
-                  {0.0f, 0.0f, 0.0f, 1.0f});
-      }
+      txt.printWorld(rocketPos, 0.0f, 0.0f, "Rocket", 10, "CO", false, false,
+                     true, TAL_CENTER, TRH_CENTER, TRV_BOTTOM,
+                     {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f});
+      std::stringstream ss;
+      ss << "Needed: " << 25 - rocketIronCount << " Iron";
+      txt.printWorld(rocketPos, 0.0f, 0.1f, ss.str(), 11, "CO", false, false,
+                     true, TAL_CENTER, TRH_CENTER, TRV_TOP,
+                     {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f});
     }
 
     // updates the FPS
@@ -1738,18 +1726,44 @@ protected:
       if (elapsedT > 1.0f) {
         float Fps = (float)countedFrames / elapsedT;
 
-        std::ostringstream oss;
-        oss << "FPS: " << Fps << "\n";
-
-        txt.print(1.0f, 1.0f, oss.str(), 1, "CO", false, false, true, TAL_RIGHT,
-                  TRH_RIGHT, TRV_BOTTOM, {1.0f, 0.0f, 0.0f, 1.0f},
-                  {0.8f, 0.8f, 0.0f, 1.0f});
+        txt.printNumber(1.0f, 1.0f, "FPS: ", 4, (int)(Fps + 0.5f), 1, "CO",
+                        false, false, true, TAL_RIGHT, TRH_RIGHT, TRV_BOTTOM,
+                        {1.0f, 0.0f, 0.0f, 1.0f}, {0.8f, 0.8f, 0.0f, 1.0f});
 
         elapsedT = 0.0f;
         countedFrames = 0;
       }
     }
 
+    // updates the GPU memory overlay
+    if (showMemory) {
+      memElapsedT += deltaT;
+      if (memElapsedT > 0.5f) {
+        MemoryStats MS;
+        getMemoryStats(MS);
+
+        std::ostringstream oss;
+        oss << std::fixed << std::setprecision(1);
+        for (int i = 0; i < MEM_CATEGORIES; i++) {
+          oss << memoryCategoryName((MemoryCategory)i) << ": "
+              << (MS.used[i] / 1048576.0) << " MB\n";
+        }
+        for (int i = 0; i < MS.heapSize.size(); i++) {
+          if (MS.heapDeviceLocal[i]) {
+            oss << "VRAM " << i << ": " << (MS.heapUsage[i] / 1048576.0)
+                << " / " << (MS.heapBudget[i] / 1048576.0) << " MB"
+                << (MS.hasBudget ? "\n" : " (no budget ext.)\n");
+          }
+        }
+
+        txt.print(-1.0f, 1.0f, oss.str(), 4, "CO", false, false, true,
+                  TAL_LEFT, TRH_LEFT, TRV_BOTTOM, {1.0f, 1.0f, 1.0f, 1.0f},
+                  {0.0f, 0.0f, 0.0f, 1.0f});
+
+        memElapsedT = 0.0f;
+      }
+    }
+
     if (isShowingWinScreen) {
       int minutes = finalGameTime / 60;
       int seconds = (int)finalGameTime % 60;
@@ -1768,7 +1782,7 @@ protected:
                 {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f});
     }
 
-    txt.updateCommandBuffer();
+    txt.updateCommandBuffer(currentImage);
   }
 
   glm::vec2 getForwardVector(float rotationRadians) {
@@ -1875,6 +1889,29 @@ protected:
         0.0f); // Return a default position if no valid intersection
   }
 
+  void showLoadingProgress() {
+    if (SC.isLoading()) {
+      int n = SC.getLoadingCount();
+      int barSize = 30;
+      int done = n > 0 ? SC.LoadedCount * barSize / n : barSize;
+      std::ostringstream oss;
+      oss << "Loading " << SC.LoadedCount << " / " << n << "\n["
+          << std::string(done, '#') << std::string(barSize - done, '.')
+          << "]";
+      txt.print(0.0f, 0.5f, oss.str(), 5, "CO", false, false, true,
+                TAL_CENTER, TRH_CENTER, TRV_MIDDLE, {1.0f, 1.0f, 1.0f, 1.0f},
+                {0.0f, 0.0f, 0.0f, 1.0f});
+    } else {
+      txt.print(0.0f, -2.0f, "", 5, "CO", false, false, true, TAL_CENTER,
+                TRH_CENTER, TRV_MIDDLE, {1.0f, 1.0f, 1.0f, 1.0f},
+                {0.0f, 0.0f, 0.0f, 1.0f});
+      std::cout << "[Startup] Scene fully loaded after "
+                << Profiler::now() / 1000.0 << " ms\n";
+      // all the meshes have been extracted: the parsed documents can go
+      AssetFile::clearCache();
+    }
+  }
+
   void hideInGameUI() {
     // FPS counter
     txt.print(0.0f, -2.0f, "", 1, "CO", false, false, true, TAL_RIGHT,
@@ -2117,7 +2154,7 @@ protected:
               std::make_shared<PlacedConveyor>(newPlacedObject));
         } break;
         }
-        app->submitCommandBuffer("main", 0, populateCommandBufferAccess, app);
+        app->submitMainCommandBuffer();
       } else {
         std::cout << "Cannot place object here: position is invalid."
                   << std::endl;
@@ -2191,7 +2228,7 @@ protected:
                            {1.0f, 1.0f, 1.0f, 1.0f}, {0.0f, 0.0f, 0.0f, 1.0f});
             app->placedObjects.erase(it);
             removed = true;
-            app->submitCommandBuffer("main", 0, populateCommandBufferAccess, app);
+            app->submitMainCommandBuffer();
             break;
           }
         }
@@ -2209,9 +2246,19 @@ protected:
 };
 
 // This is the main: probably you do not need to touch this!
-int main() {
+int main(int argc, char *argv[]) {
   Factotum app;
 
+  // --trace[=file.json] saves a chrome://tracing timeline of the startup
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    if (arg == "--trace") {
+      Profiler::enable();
+    } else if (arg.rfind("--trace=", 0) == 0) {
+      Profiler::enable(arg.substr(8));
+    }
+  }
+
   try {
     app.run();
   } catch (const std::exception &e) {
@@ -0,0 +1,220 @@
+// Measures SkeletalAnimation::Sample on rigs of 65 joints. A glTF with a
+// skin of 65 joints and a looping clip that moves all of them is written to a
+// temporary file, and loaded like the animated assets of the game. Each rig
+// has its own playback (AnimBlender), and all of them are sampled every frame,
+// one at a time and then with SampleBatch().
+// The tracks are also sampled alone, with and without a keyframe cursor, to
+// show the cost of the keyframe search; the two must give the same samples.
+//
+// usage: animbench [rigs] [frames] [keyframes]
+
+#include "modules/Starter.hpp"
+#include "modules/Animations.hpp"
+
+#include <cstdio>
+
+const int BENCH_JOINTS = 65;
+
+// appends the values to the buffer, and returns the accessor that reads them
+static int addAccessor(tinygltf::Model &M, const std::vector<float> &vals, int type, int count) {
+	tinygltf::Buffer &B = M.buffers[0];
+	tinygltf::BufferView BV;
+	BV.buffer = 0;
+	BV.byteOffset = B.data.size();
+	BV.byteLength = vals.size() * sizeof(float);
+	const unsigned char *src = reinterpret_cast<const unsigned char *>(vals.data());
+	B.data.insert(B.data.end(), src, src + BV.byteLength);
+	M.bufferViews.push_back(BV);
+
+	tinygltf::Accessor A;
+	A.bufferView = M.bufferViews.size() - 1;
+	A.componentType = TINYGLTF_COMPONENT_TYPE_FLOAT;
+	A.type = type;
+	A.count = count;
+	M.accessors.push_back(A);
+	return M.accessors.size() - 1;
+}
+
+// a binary tree of joints (the parent of joint i is (i-1)/2), with a clip
+// that translates and rotates every joint
+static void makeRig(tinygltf::Model &M, int keyFrames) {
+	M.buffers.resize(1);
+	M.asset.version = "2.0";
+
+	std::vector<float> times(keyFrames);
+	for(int k = 0; k < keyFrames; k++) {
+		times[k] = (float)k / 30.0f;
+	}
+	int timeAcc = addAccessor(M, times, TINYGLTF_TYPE_SCALAR, keyFrames);
+
+	tinygltf::Skin S;
+	std::vector<float> ibms;
+	tinygltf::Animation A;
+	A.name = "Clip";
+	for(int j = 0; j < BENCH_JOINTS; j++) {
+		tinygltf::Node N;
+		N.name = "Joint" + std::to_string(j);
+		N.translation = {0.0, 0.1, 0.0};
+		if(2 * j + 1 < BENCH_JOINTS) N.children.push_back(2 * j + 1);
+		if(2 * j + 2 < BENCH_JOINTS) N.children.push_back(2 * j + 2);
+		M.nodes.push_back(N);
+		S.joints.push_back(j);
+
+		int depth = 0;
+		for(int p = j; p > 0; p = (p - 1) / 2) depth++;
+		glm::mat4 IBM = glm::translate(glm::mat4(1), glm::vec3(0.0f, -0.1f * (depth + 1), 0.0f));
+		ibms.insert(ibms.end(), &IBM[0][0], &IBM[0][0] + 16);
+
+		std::vector<float> T, R;
+		for(int k = 0; k < keyFrames; k++) {
+			float a = 0.3f * sinf(times[k] * 2.0f + j);
+			T.insert(T.end(), {0.0f, 0.1f + 0.01f * a, 0.0f});
+			glm::quat Q = glm::angleAxis(a, glm::vec3(0.0f, 0.0f, 1.0f));
+			R.insert(R.end(), {Q.x, Q.y, Q.z, Q.w});
+		}
+		int tAcc = addAccessor(M, T, TINYGLTF_TYPE_VEC3, keyFrames);
+		int rAcc = addAccessor(M, R, TINYGLTF_TYPE_VEC4, keyFrames);
+		for(int c = 0; c < 2; c++) {
+			tinygltf::AnimationSampler AS;
+			AS.input = timeAcc;
+			AS.output = (c == 0) ? tAcc : rAcc;
+			A.samplers.push_back(AS);
+			tinygltf::AnimationChannel AC;
+			AC.sampler = A.samplers.size() - 1;
+			AC.target_node = j;
+			AC.target_path = (c == 0) ? "translation" : "rotation";
+			A.channels.push_back(AC);
+		}
+	}
+	S.inverseBindMatrices = addAccessor(M, ibms, TINYGLTF_TYPE_MAT4, BENCH_JOINTS);
+	S.skeleton = 0;
+	M.skins.push_back(S);
+	M.animations.push_back(A);
+
+	tinygltf::Scene SC;
+	SC.nodes.push_back(0);
+	M.scenes.push_back(SC);
+	M.defaultScene = 0;
+}
+
+int main(int argc, char **argv) {
+	int rigs = (argc > 1) ? std::stoi(argv[1]) : 100;
+	int frames = (argc > 2) ? std::stoi(argv[2]) : 600;
+	int keyFrames = (argc > 3) ? std::stoi(argv[3]) : 60;
+	using Clock = std::chrono::steady_clock;
+	const float dt = 1.0f / 60.0f;
+
+	tinygltf::Model M;
+	makeRig(M, keyFrames);
+	std::string file = (std::filesystem::temp_directory_path() / "animbench.gltf").string();
+	tinygltf::TinyGLTF writer;
+	if(!writer.WriteGltfSceneToFile(&M, file, false, true, false, false)) {
+		std::cout << "Error writing " << file << "\n";
+		return 1;
+	}
+
+	AssetFile AF;
+	AF.init(file, GLTF);
+	Animations Anim;
+	Anim.init(AF);
+	SkeletalAnimation SKA;
+	SKA.init(&Anim, 1, "Clip");
+
+	std::vector<AnimBlender> AB(rigs);
+	for(int r = 0; r < rigs; r++) {
+		AB[r].init({{0, -1, 0.01f * r}});
+	}
+
+	auto t0 = Clock::now();
+	float check = 0.0f;
+	for(int f = 0; f < frames; f++) {
+		for(int r = 0; r < rigs; r++) {
+			AB[r].Advance(dt);
+			SKA.Sample(AB[r]);
+			check += (*SKA.getTransformMatrices())[BENCH_JOINTS - 1][3][1];
+		}
+	}
+	auto t1 = Clock::now();
+
+	std::vector<AnimBlender> BAB(rigs);
+	std::vector<AnimBlender *> BABp(rigs);
+	for(int r = 0; r < rigs; r++) {
+		BAB[r].init({{0, -1, 0.01f * r}});
+		BABp[r] = &BAB[r];
+	}
+	SKA.SampleBatch(BABp.data(), rigs);		// starts the threads
+	auto tb0 = Clock::now();
+	glm::mat4 *Palette = nullptr;
+	for(int f = 0; f < frames; f++) {
+		for(int r = 0; r < rigs; r++) {
+			BAB[r].Advance(dt);
+		}
+		Palette = SKA.SampleBatch(BABp.data(), rigs);
+	}
+	auto tb1 = Clock::now();
+
+	// the batch approximates the slerp: the palettes must be close
+	float maxDiff = 0.0f;
+	for(int r = 0; r < rigs; r++) {
+		SKA.Sample(BAB[r]);
+		std::vector<glm::mat4> &TMs = *SKA.getTransformMatrices();
+		for(int j = 0; j < BENCH_JOINTS; j++) {
+			for(int c = 0; c < 4; c++) {
+				glm::vec4 d = glm::abs(TMs[j][c] - Palette[r * BENCH_JOINTS + j][c]);
+				maxDiff = std::max(maxDiff, std::max(std::max(d.x, d.y), std::max(d.z, d.w)));
+			}
+		}
+	}
+
+	// the tracks alone: binary search at every sample, then the cursor
+	std::vector<AnimTrack *> tracks;
+	for(int j = 0; j < BENCH_JOINTS; j++) {
+		tracks.push_back(Anim.getAnim("Clip#" + std::to_string(j)));
+	}
+	std::vector<glm::mat4> searched(frames * BENCH_JOINTS), cursored(frames * BENCH_JOINTS);
+	auto t2 = Clock::now();
+	for(int f = 0; f < frames; f++) {
+		for(int j = 0; j < BENCH_JOINTS; j++) {
+			searched[f * BENCH_JOINTS + j] = tracks[j]->Sample(f * dt, 0, -1, false, nullptr);
+		}
+	}
+	auto t3 = Clock::now();
+	std::vector<AnimCursor> cursors(BENCH_JOINTS);
+	for(int f = 0; f < frames; f++) {
+		for(int j = 0; j < BENCH_JOINTS; j++) {
+			cursored[f * BENCH_JOINTS + j] = tracks[j]->Sample(f * dt, 0, -1, false, &cursors[j]);
+		}
+	}
+	auto t4 = Clock::now();
+
+	// the cursor only skips the search: the samples must be the same
+	int mismatches = 0;
+	for(size_t i = 0; i < searched.size(); i++) {
+		for(int c = 0; c < 4; c++) {
+			glm::vec4 d = searched[i][c] - cursored[i][c];
+			if((d.x != 0.0f) || (d.y != 0.0f) || (d.z != 0.0f) || (d.w != 0.0f)) {
+				mismatches++;
+				break;
+			}
+		}
+	}
+
+	auto us = [](Clock::time_point a, Clock::time_point b) {
+		return std::chrono::duration<double, std::micro>(b - a).count();
+	};
+	printf("%d rigs of %d joints, %d keyframes, %d frames\n", rigs, BENCH_JOINTS, keyFrames, frames);
+	printf("  SkeletalAnimation::Sample: %8.2f us/rig, %8.1f us/frame\n",
+		   us(t0, t1) / ((double)frames * rigs), us(t0, t1) / frames);
+	printf("  SampleBatch:               %8.2f us/rig, %8.1f us/frame (max difference %g)\n",
+		   us(tb0, tb1) / ((double)frames * rigs), us(tb0, tb1) / frames, maxDiff);
+	printf("  %d tracks, binary search:  %8.2f us/frame\n", BENCH_JOINTS, us(t2, t3) / frames);
+	printf("  %d tracks, cursor:         %8.2f us/frame (%d samples differ)\n", BENCH_JOINTS, us(t3, t4) / frames, mismatches);
+	if(!std::isfinite(check) || (mismatches > 0) || !(maxDiff <= 1e-2f)) {
+		printf("Error: the samples differ\n");
+		return 1;
+	}
+
+	SKA.cleanup();
+	std::filesystem::remove(file);
+	return 0;
+}
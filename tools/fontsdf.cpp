@@ -0,0 +1,174 @@
+// Builds the signed distance field atlas of a font family from the bitmap
+// atlas of the TextMaker. Only the large regular, italic, bold and bold italic
+// faces are used: the small ones are replaced by scaling the text. Each
+// channel of the atlas (fill, stroke and shadow) gets its own distance field,
+// stored as 0.5 on the edge of the glyph and growing inside.
+//
+// usage: fontsdf Fonts.png CO|SS|SR output.fsdf [scale] [spread]
+//        writes output.fsdf (metrics) and output.png (atlas)
+
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+#define FONTS_IMPLEMENTATION
+#include "modules/Fonts.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+struct GlyphRef {
+	int face, c;
+	int srcX, srcY;					// padded region of the bitmap atlas
+	int w, h;						// size in the distance field atlas
+	int x, y;						// position in the distance field atlas
+};
+
+// distance (in bitmap pixels) from the center of pixel (px, py) to the
+// nearest pixel of the glyph in the opposite state, positive inside
+static float signedDistance(const unsigned char *img, int imgW, int ch,
+							const CharData &d, int px, int py, int spread) {
+	auto inside = [&](int x, int y) {
+		if((x < d.x) || (y < d.y) || (x >= d.x + d.width) || (y >= d.y + d.height)) {
+			return false;	// other glyphs may be next to this one
+		}
+		return img[(y * imgW + x) * 4 + ch] >= 128;
+	};
+	bool in = inside(px, py);
+	int best = spread * spread + 1;
+	for(int dy = -spread; dy <= spread; dy++) {
+		for(int dx = -spread; dx <= spread; dx++) {
+			int d2 = dx * dx + dy * dy;
+			if((d2 < best) && (inside(px + dx, py + dy) != in)) {
+				best = d2;
+			}
+		}
+	}
+	float dist = std::min(std::sqrt((float)best) - 0.5f, (float)spread);
+	return in ? dist : -dist;
+}
+
+int main(int argc, char **argv) {
+	if(argc < 4) {
+		std::cout << "usage: " << argv[0] << " Fonts.png CO|SS|SR output.fsdf [scale] [spread]\n";
+		return 1;
+	}
+	std::string in = argv[1];
+	std::string family = argv[2];
+	std::string out = argv[3];
+	float scale = (argc > 4) ? std::stof(argv[4]) : 0.5f;
+	int spread = (argc > 5) ? std::stoi(argv[5]) : 8;
+
+	int firstFace = (family == "SS" ? 8 : (family == "SR" ? 16 : 0));
+	const int styles = 4;			// regular, italic, bold, bold italic
+	const int smallFace = 4;		// offset of the small variant of a face
+
+	int imgW, imgH, imgC;
+	unsigned char *img = stbi_load(in.c_str(), &imgW, &imgH, &imgC, 4);
+	if(img == nullptr) {
+		std::cout << "Error loading " << in << "\n";
+		return 1;
+	}
+	if((imgW != mainFont.texW) || (imgH != mainFont.texH)) {
+		std::cout << "Error: " << in << " does not match the glyph tables\n";
+		return 1;
+	}
+
+	// padded regions, sized so that they are a whole number of atlas pixels
+	int nChars = mainFont.maxChar - mainFont.minChar + 1;
+	std::vector<GlyphRef> G;
+	for(int f = 0; f < styles; f++) {
+		for(int c = 0; c < nChars; c++) {
+			const CharData &d = mainFont.faces[firstFace + f].P[c];
+			if((d.width == 0) || (d.height == 0)) continue;
+			GlyphRef R;
+			R.face = f;
+			R.c = c;
+			R.w = (int)std::ceil((d.width  + 2 * spread) * scale);
+			R.h = (int)std::ceil((d.height + 2 * spread) * scale);
+			R.srcX = d.x - spread;
+			R.srcY = d.y - spread;
+			G.push_back(R);
+		}
+	}
+
+	// shelf packing, tallest glyphs first
+	int atlasW = 1024;
+	std::vector<GlyphRef *> order;
+	for(auto &R : G) order.push_back(&R);
+	std::sort(order.begin(), order.end(), [](GlyphRef *a, GlyphRef *b) {return a->h > b->h;});
+	int x = 0, y = 0, shelf = 0;
+	for(auto R : order) {
+		if(x + R->w > atlasW) {
+			x = 0;
+			y += shelf;
+			shelf = 0;
+		}
+		R->x = x;
+		R->y = y;
+		x += R->w;
+		shelf = std::max(shelf, R->h);
+	}
+	int atlasH = 1;
+	while(atlasH < y + shelf) atlasH *= 2;
+
+	std::vector<unsigned char> atlas((size_t)atlasW * atlasH * 4, 0);
+	for(auto &R : G) {
+		const CharData &d = mainFont.faces[firstFace + R.face].P[R.c];
+		for(int ay = 0; ay < R.h; ay++) {
+			for(int ax = 0; ax < R.w; ax++) {
+				int px = R.srcX + (int)((ax + 0.5f) / scale);
+				int py = R.srcY + (int)((ay + 0.5f) / scale);
+				unsigned char *o = &atlas[((size_t)(R.y + ay) * atlasW + R.x + ax) * 4];
+				for(int ch = 0; ch < 3; ch++) {
+					float sd = signedDistance(img, imgW, ch, d, px, py, spread);
+					o[ch] = (unsigned char)std::lround(std::clamp(0.5f + 0.5f * sd / spread, 0.0f, 1.0f) * 255.0f);
+				}
+				o[3] = 255;
+			}
+		}
+	}
+	stbi_image_free(img);
+
+	// metrics: atlas rectangles in atlas pixels, offsets in text pixels
+	Font F;
+	F.minChar = mainFont.minChar;
+	F.maxChar = mainFont.maxChar;
+	F.texW = atlasW;
+	F.texH = atlasH;
+	F.sdf = true;
+	F.family = family;
+	F.atlasScale = scale;
+	F.spread = spread;
+	F.smallScale = (float)mainFont.faces[firstFace + smallFace].lineHeight /
+				   (float)mainFont.faces[firstFace].lineHeight;
+	F.faces.resize(styles);
+	for(int f = 0; f < styles; f++) {
+		F.faces[f].lineHeight = mainFont.faces[firstFace + f].lineHeight;
+		F.faces[f].P = mainFont.faces[firstFace + f].P;
+		for(auto &d : F.faces[f].P) {
+			d.width = d.height = 0;
+		}
+	}
+	for(auto &R : G) {
+		CharData &d = F.faces[R.face].P[R.c];
+		d.x = R.x;
+		d.y = R.y;
+		d.width = R.w;
+		d.height = R.h;
+		d.xoffset -= spread;
+		d.yoffset -= spread;
+	}
+
+	size_t dot = out.rfind('.');
+	std::string png = ((dot == std::string::npos) ? out : out.substr(0, dot)) + ".png";
+	if(!stbi_write_png(png.c_str(), atlasW, atlasH, 4, atlas.data(), atlasW * 4) ||
+	   !saveFontSDF(out, F)) {
+		std::cout << "Error writing " << out << "\n";
+		return 1;
+	}
+	std::cout << in << " (" << family << ") -> " << out << ", " << png << " ("
+			  << G.size() << " glyphs, " << atlasW << "x" << atlasH << ")\n";
+	return 0;
+}
@@ -0,0 +1,79 @@
+// Converts ASCII glTF assets (.gltf + .bin or embedded buffers) to binary
+// glTF (.glb). All the buffers are merged in the single BIN chunk of the .glb,
+// while images are left as external files next to the output, since the
+// engine loads textures on its own.
+//
+// usage: gltf2glb input.gltf [output.glb]
+
+#define TINYGLTF_IMPLEMENTATION
+#define STB_IMAGE_IMPLEMENTATION
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <tiny_gltf.h>
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+// images are not decoded: their uri is written back unchanged
+static bool keepImage(tinygltf::Image *, const int, std::string *, std::string *,
+					  int, int, const unsigned char *, int, void *) {
+	return true;
+}
+
+// moves all the buffers into buffer 0, which becomes the BIN chunk
+static void mergeBuffers(tinygltf::Model &model) {
+	if(model.buffers.size() == 0) return;
+
+	std::vector<size_t> base(model.buffers.size());
+	tinygltf::Buffer merged;
+	for(size_t i = 0; i < model.buffers.size(); i++) {
+		// glTF requires the chunks to be 4 bytes aligned
+		while(merged.data.size() % 4 != 0) {
+			merged.data.push_back(0);
+		}
+		base[i] = merged.data.size();
+		merged.data.insert(merged.data.end(), model.buffers[i].data.begin(), model.buffers[i].data.end());
+	}
+	for(auto &BV : model.bufferViews) {
+		BV.byteOffset += base[BV.buffer];
+		BV.buffer = 0;
+	}
+	model.buffers.clear();
+	model.buffers.push_back(merged);
+}
+
+int main(int argc, char **argv) {
+	if(argc < 2) {
+		std::cout << "usage: " << argv[0] << " input.gltf [output.glb]\n";
+		return 1;
+	}
+	std::string in = argv[1];
+	std::string out;
+	if(argc > 2) {
+		out = argv[2];
+	} else {
+		size_t dot = in.rfind('.');
+		out = ((dot == std::string::npos) ? in : in.substr(0, dot)) + ".glb";
+	}
+
+	tinygltf::TinyGLTF loader;
+	tinygltf::Model model;
+	std::string warn, err;
+	loader.SetImageLoader(keepImage, nullptr);
+	if(!loader.LoadASCIIFromFile(&model, &err, &warn, in)) {
+		std::cout << "Error loading " << in << ": " << err << "\n";
+		return 1;
+	}
+	if(warn != "") {
+		std::cout << "Warning: " << warn << "\n";
+	}
+
+	mergeBuffers(model);
+	if(!loader.WriteGltfSceneToFile(&model, out, false, true, false, true)) {
+		std::cout << "Error writing " << out << "\n";
+		return 1;
+	}
+	std::cout << in << " -> " << out << " (" << model.meshes.size() << " meshes, "
+			  << (model.buffers.size() ? model.buffers[0].data.size() : 0) << " bytes of buffers)\n";
+	return 0;
+}
@@ -0,0 +1,274 @@
+// Checks the decoding of the MGCG files (Inflate.hpp):
+// - StreamInflater on streams that mix stored blocks with Huffman ones. sdefl
+//   never emits stored blocks, so these streams are written here: a stored
+//   block after a compressed one starts with look-ahead bits already loaded,
+//   and its bytes are then copied straight from the input.
+// - StreamInflater on the output of sdefl at every level: dynamic Huffman
+//   blocks with back-references, as in the MGCG files.
+// - CBCDecryptStream on data encrypted by plusaes spanning several of its
+//   blocks, alone and feeding the inflater as the model loader does.
+// Each stream is inflated with the input handed out in chunks of several sizes.
+//
+// usage: inflatetest [streams]
+
+#define INFLATE_IMPLEMENTATION
+#include "modules/Inflate.hpp"
+
+#define SDEFL_IMPLEMENTATION
+#include <sdefl.h>
+
+#include <cstdio>
+#include <random>
+#include <string>
+
+// DEFLATE bit stream: fields are written from the least significant bit,
+// Huffman codes from the most significant one
+struct BitWriter {
+	std::vector<unsigned char> bytes;
+	uint32_t acc = 0;
+	int n = 0;
+
+	void put(uint32_t v, int bits) {
+		for(int i = 0; i < bits; i++) {
+			acc |= ((v >> i) & 1) << n;
+			if(++n == 8) {
+				bytes.push_back((unsigned char)acc);
+				acc = 0;
+				n = 0;
+			}
+		}
+	}
+	void putCode(uint32_t code, int len) {
+		for(int i = len - 1; i >= 0; i--) {
+			put((code >> i) & 1, 1);
+		}
+	}
+	void align() {
+		if(n > 0) {
+			put(0, 8 - n);
+		}
+	}
+};
+
+// literals only, with the fixed codes
+static void fixedBlock(BitWriter &W, const std::vector<unsigned char> &data, bool last) {
+	W.put(last ? 1 : 0, 1);
+	W.put(1, 2);
+	for(unsigned char c : data) {
+		if(c < 144) {
+			W.putCode(0x30 + c, 8);
+		} else {
+			W.putCode(0x190 + (c - 144), 9);
+		}
+	}
+	W.putCode(0, 7);	// end of block
+}
+
+static void storedBlock(BitWriter &W, const std::vector<unsigned char> &data, bool last) {
+	W.put(last ? 1 : 0, 1);
+	W.put(0, 2);
+	W.align();
+	W.put(data.size(), 16);
+	W.put(data.size() ^ 0xFFFF, 16);
+	W.bytes.insert(W.bytes.end(), data.begin(), data.end());
+}
+
+struct TestStream {
+	BitWriter W;
+	std::vector<unsigned char> expected;
+
+	void add(bool stored, size_t len, bool last, std::mt19937 &rng) {
+		std::vector<unsigned char> data(len);
+		for(auto &c : data) {
+			c = (unsigned char)rng();
+		}
+		if(stored) {
+			storedBlock(W, data, last);
+		} else {
+			fixedBlock(W, data, last);
+		}
+		expected.insert(expected.end(), data.begin(), data.end());
+		if(last) {
+			W.align();
+		}
+	}
+};
+
+// inflates the stream reading at most chunk bytes at a time
+static bool check(const std::vector<unsigned char> &stream, const std::vector<unsigned char> &expected, size_t chunk) {
+	std::vector<unsigned char> out(expected.size());
+	size_t pos = 0;
+	StreamInflater SI;
+	long long n = SI.inflate(out.data(), out.size(), [&](const unsigned char *&ptr) -> size_t {
+		size_t k = std::min(chunk, stream.size() - pos);
+		ptr = stream.data() + pos;
+		pos += k;
+		return k;
+	});
+	return (n == (long long)expected.size()) && (out == expected);
+}
+
+// text like data, made of words repeated at any distance, with some noise
+static std::vector<unsigned char> makeText(size_t len, std::mt19937 &rng) {
+	static const char *words[] = {"vertex", "index", "buffer", "normal", "texture", "uv", "joint",
+								  "weight", "matrix", "node", "mesh", "scene", " ", " ", ",", "\n"};
+	std::vector<unsigned char> data;
+	while(data.size() < len) {
+		if(rng() % 16 == 0) {
+			data.push_back((unsigned char)rng());
+		} else {
+			const char *w = words[rng() % 16];
+			data.insert(data.end(), w, w + strlen(w));
+		}
+	}
+	data.resize(len);
+	return data;
+}
+
+static std::vector<unsigned char> deflate(const std::vector<unsigned char> &data, int level) {
+	static sdefl S;		// too large for the stack
+	std::vector<unsigned char> out(sdefl_bound((int)data.size()));
+	int n = sdeflate(&S, out.data(), data.data(), (int)data.size(), level);
+	out.resize(n);
+	return out;
+}
+
+static const unsigned char testKey[] = "CG2023SkelKey128";
+static const unsigned char testIv[16] = {
+	0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+	0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+};
+
+static std::vector<unsigned char> encrypt(const std::vector<unsigned char> &data) {
+	std::vector<unsigned char> out(plusaes::get_padded_encrypted_size(data.size()));
+	plusaes::encrypt_cbc(data.data(), data.size(), testKey, 16, &testIv, out.data(), out.size(), true);
+	return out;
+}
+
+// decrypts in blocks, and compares their concatenation
+static bool checkDecrypt(const std::vector<unsigned char> &cipher, const std::vector<unsigned char> &expected, int &blocks) {
+	std::vector<unsigned char> key(testKey, testKey + 16);
+	std::vector<unsigned char> out;
+	CBCDecryptStream DS;
+	DS.start(cipher.data(), cipher.size(), key, testIv);
+	const unsigned char *ptr;
+	size_t n;
+	blocks = 0;
+	try {
+		while((n = DS.next(ptr)) > 0) {
+			out.insert(out.end(), ptr, ptr + n);
+			blocks++;
+		}
+	} catch(const std::runtime_error &e) {
+		// wrong padding in the last block
+		return false;
+	}
+	DS.stop();
+	return out == expected;
+}
+
+// inflates while the following blocks are decrypted
+static bool checkDecryptInflate(const std::vector<unsigned char> &cipher, const std::vector<unsigned char> &expected) {
+	std::vector<unsigned char> key(testKey, testKey + 16);
+	std::vector<unsigned char> out(expected.size());
+	CBCDecryptStream DS;
+	DS.start(cipher.data(), cipher.size(), key, testIv);
+	StreamInflater SI;
+	long long n;
+	try {
+		n = SI.inflate(out.data(), out.size(), [&](const unsigned char *&ptr) -> size_t {
+			return DS.next(ptr);
+		});
+	} catch(const std::runtime_error &e) {
+		return false;
+	}
+	DS.stop();
+	return (n == (long long)expected.size()) && (out == expected);
+}
+
+int main(int argc, char **argv) {
+	int streams = (argc > 1) ? std::stoi(argv[1]) : 200;
+	std::mt19937 rng(1234);
+	const size_t chunks[] = {1, 7, 4096, (size_t)-1};
+
+	// the first stream is a compressed block followed by a stored one, the
+	// others are random sequences of both kinds
+	std::vector<TestStream> tests(streams + 1);
+	tests[0].add(false, 100, false, rng);
+	tests[0].add(true, 1000, true, rng);
+	for(int s = 1; s <= streams; s++) {
+		int blocks = 1 + rng() % 6;
+		for(int b = 0; b < blocks; b++) {
+			bool stored = (rng() % 2 == 0);
+			size_t len = (rng() % 8 == 0) ? rng() % 65536 : rng() % 300;
+			tests[s].add(stored, len, b == blocks - 1, rng);
+		}
+	}
+
+	int failed = 0;
+	for(int s = 0; s <= streams; s++) {
+		for(size_t chunk : chunks) {
+			if(!check(tests[s].W.bytes, tests[s].expected, chunk)) {
+				printf("Error: stream %d (%zu bytes) differs, read in chunks of %zu bytes\n",
+					   s, tests[s].expected.size(), chunk);
+				failed++;
+			}
+		}
+	}
+	printf("%d streams with stored blocks, %d failed\n", streams + 1, failed);
+
+	// sdefl: text (back-references) and random bytes (literals only), the
+	// largest split by sdefl in several blocks
+	int sdeflFailed = 0, sdeflRuns = 0;
+	std::vector<std::vector<unsigned char>> inputs = {
+		makeText(1000, rng), makeText(100000, rng), makeText(600000, rng), std::vector<unsigned char>(70000, 'a')
+	};
+	inputs.push_back(std::vector<unsigned char>(50000));
+	for(auto &c : inputs.back()) {
+		c = (unsigned char)rng();
+	}
+	for(int level = SDEFL_LVL_MIN; level <= SDEFL_LVL_MAX; level++) {
+		for(int i = 0; i < inputs.size(); i++) {
+			std::vector<unsigned char> z = deflate(inputs[i], level);
+			// the first block header: BFINAL, then BTYPE 2 (dynamic Huffman)
+			if(((z[0] >> 1) & 3) != 2) {
+				printf("Error: sdefl level %d, input %d: not a dynamic Huffman block\n", level, i);
+				sdeflFailed++;
+			}
+			for(size_t chunk : chunks) {
+				sdeflRuns++;
+				if(!check(z, inputs[i], chunk)) {
+					printf("Error: sdefl level %d, input %d (%zu -> %zu bytes) differs, read in chunks of %zu bytes\n",
+						   level, i, inputs[i].size(), z.size(), chunk);
+					sdeflFailed++;
+				}
+			}
+		}
+	}
+	printf("%d sdefl streams, %d failed\n", sdeflRuns, sdeflFailed);
+	failed += sdeflFailed;
+
+	// AES-CBC: each block of the stream takes its iv from the previous one
+	int cbcFailed = 0;
+	for(size_t len : {(size_t)1000, (size_t)256 * 1024 - 16, (size_t)256 * 1024, (size_t)3 * 256 * 1024 + 5}) {
+		std::vector<unsigned char> plain(len);
+		for(auto &c : plain) {
+			c = (unsigned char)rng();
+		}
+		int blocks;
+		if(!checkDecrypt(encrypt(plain), plain, blocks)) {
+			printf("Error: %zu bytes decrypted in %d blocks differ\n", len, blocks);
+			cbcFailed++;
+		}
+	}
+	std::vector<unsigned char> text = makeText(2000000, rng);
+	std::vector<unsigned char> cipher = encrypt(deflate(text, SDEFL_LVL_DEF));
+	if(!checkDecryptInflate(cipher, text)) {
+		printf("Error: %zu bytes, inflated while decrypting %zu, differ\n", text.size(), cipher.size());
+		cbcFailed++;
+	}
+	printf("5 AES-CBC streams, %d failed\n", cbcFailed);
+	failed += cbcFailed;
+
+	return (failed > 0) ? 1 : 0;
+}
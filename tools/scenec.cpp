@@ -0,0 +1,31 @@
+// Compiles a scene description (.json) into the binary format loaded by the
+// Scene module (.fscn). All the ids are resolved to indices, so at startup
+// the engine only needs to read the file and check its header.
+//
+// usage: scenec scene.json [scene.fscn]
+
+#define SCENEBLOB_IMPLEMENTATION
+#include "modules/SceneBlob.hpp"
+
+int main(int argc, char **argv) {
+	if(argc < 2) {
+		std::cout << "usage: " << argv[0] << " scene.json [scene.fscn]\n";
+		return 1;
+	}
+	std::string in = argv[1];
+	std::string out = (argc > 2) ? argv[2] : SceneBlob::compiledName(in);
+
+	SceneBlob Blob;
+	if(!Blob.compile(in)) {
+		std::cout << "Error compiling " << in << "\n";
+		return 1;
+	}
+	if(!Blob.save(out)) {
+		std::cout << "Error writing " << out << "\n";
+		return 1;
+	}
+	const SceneBlobHeader *H = Blob.header();
+	std::cout << in << " -> " << out << " (" << H->modelCount << " models, " << H->textureCount << " textures, "
+			  << H->instanceCount << " instances, " << H->size << " bytes)\n";
+	return 0;
+}
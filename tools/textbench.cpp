@@ -0,0 +1,126 @@
+// Measures the time spent formatting and laying out the labels of a frame:
+// 1000 labels like the ones of the furnaces ("Ore: 12"), whose values change
+// every few frames. It compares the layout of the TextMaker before the glyph
+// cache (stringstream, lines built one character at a time, block copied in
+// the map) with layoutText() alone, and with the TextLayoutCache.
+//
+// usage: textbench [labels] [frames]
+
+#define FONTS_IMPLEMENTATION
+#include "modules/Fonts.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <sstream>
+
+struct LegacyBlock {
+	std::string Text;
+	int w, h, nlines, totChars;
+	std::vector<int> linew;
+	std::vector<std::string> lines;
+};
+
+// the measureText of the TextMaker, as it was
+static void legacyMeasure(std::string Text, int &fontId, int &w, int &h, int &nlines, int &totChars,
+						  std::vector<int> &linew, std::vector<std::string> &lines) {
+	int curWidth = 0;
+	std::string curStr = "";
+	h = 0;
+	w = 0;
+	nlines = 0;
+	totChars = 0;
+	for(int j = 0; j < Text.length(); j++) {
+		int c = ((int)Text[j]) - mainFont.minChar;
+		if((c >= 0) && (c <= mainFont.maxChar - mainFont.minChar)) {
+			curWidth += mainFont.faces[fontId].P[c].xadvance;
+			curStr = curStr + Text[j];
+			totChars++;
+		} else if(Text[j] == '\n') {
+			w = std::max(w, curWidth);
+			h += mainFont.faces[fontId].lineHeight;
+			linew.push_back(curWidth);
+			lines.push_back(curStr);
+			nlines++;
+			curStr = "";
+			curWidth = 0;
+		}
+	}
+	if(curWidth > 0) {
+		w = std::max(w, curWidth);
+		h += mainFont.faces[fontId].lineHeight;
+		linew.push_back(curWidth);
+		lines.push_back(curStr);
+		nlines++;
+	}
+}
+
+// value of a label in a frame: it changes every 30 frames
+static int labelValue(int label, int frame) {
+	return (label * 7 + frame / 30) % 100;
+}
+
+int main(int argc, char **argv) {
+	int labels = (argc > 1) ? std::stoi(argv[1]) : 1000;
+	int frames = (argc > 2) ? std::stoi(argv[2]) : 300;
+	const int fontId = 4;		// CO, small
+	using Clock = std::chrono::steady_clock;
+	size_t widths[3] = {0, 0, 0};	// the three must agree
+
+	std::unordered_map<int, LegacyBlock> legacyBlocks;
+	auto t0 = Clock::now();
+	for(int f = 0; f < frames; f++) {
+		for(int i = 0; i < labels; i++) {
+			std::stringstream ss;
+			ss << (i % 2 ? "Coal: " : "Ore: ") << labelValue(i, f);
+			int w = 0, h = 0, nlines = 0, totChars, fid = fontId;
+			std::vector<int> linew = {};
+			std::vector<std::string> lines = {};
+			legacyMeasure(ss.str(), fid, w, h, nlines, totChars, linew, lines);
+			legacyBlocks[i] = {ss.str(), w, h, nlines, totChars, linew, lines};
+			widths[0] += w;
+		}
+	}
+	auto t1 = Clock::now();
+
+	TextLayout L;
+	std::string Text;
+	std::vector<std::vector<GlyphQuad>> runs(labels);
+	char buf[32];
+	for(int f = 0; f < frames; f++) {
+		for(int i = 0; i < labels; i++) {
+			snprintf(buf, sizeof(buf), "%s%d", i % 2 ? "Coal: " : "Ore: ", labelValue(i, f));
+			Text = buf;
+			layoutText(mainFont, fontId, 0.0f, Text.data(), Text.size(), L);
+			runs[i].assign(L.glyphs.begin(), L.glyphs.end());
+			widths[1] += L.w;
+		}
+	}
+	auto t2 = Clock::now();
+
+	TextLayoutCache cache;
+	cache.init();
+	for(int f = 0; f < frames; f++) {
+		for(int i = 0; i < labels; i++) {
+			snprintf(buf, sizeof(buf), "%s%d", i % 2 ? "Coal: " : "Ore: ", labelValue(i, f));
+			Text = buf;
+			const TextLayout &CL = cache.get(mainFont, fontId, 0.0f, Text);
+			runs[i].assign(CL.glyphs.begin(), CL.glyphs.end());
+			widths[2] += CL.w;
+		}
+	}
+	auto t3 = Clock::now();
+
+	auto usPerFrame = [&](Clock::time_point a, Clock::time_point b) {
+		return std::chrono::duration<double, std::micro>(b - a).count() / frames;
+	};
+	printf("%d labels, %d frames\n", labels, frames);
+	printf("  stringstream + legacy measureText: %8.1f us/frame\n", usPerFrame(t0, t1));
+	printf("  snprintf + layoutText:             %8.1f us/frame\n", usPerFrame(t1, t2));
+	printf("  snprintf + TextLayoutCache:        %8.1f us/frame (%d hits, %d misses)\n",
+		   usPerFrame(t2, t3), cache.hits, cache.misses);
+	if((widths[0] != widths[1]) || (widths[1] != widths[2])) {
+		printf("Error: the layouts differ\n");
+		return 1;
+	}
+	return 0;
+}